@@ -21,6 +21,9 @@
 
 #include <nori/mesh.h>
 
+/* Maximum number of ray traversals that are interleaved by Accel::rayIntersect() */
+#define NORI_MAX_INTERLEAVE 32
+
 NORI_NAMESPACE_BEGIN
 
 /**
@@ -80,6 +83,25 @@ public:
     bool rayIntersect(const Ray3f &ray, Intersection &its, 
         bool shadowRay = false) const;
 
+    /**
+     * \brief Intersect a batch of rays, interleaving their traversals
+     *
+     * Up to \c interleave traversals are in flight at the same time. Each
+     * of them visits a single node, issues a prefetch for the node that it
+     * will visit next, and then makes way for the next traversal. By the
+     * time a traversal resumes, its node has (hopefully) arrived in the
+     * cache, so that the memory latency of one ray is hidden behind the
+     * work done for the others. This pays off when the hierarchy does
+     * not fit into the cache.
+     *
+     * The results are identical to calling \ref rayIntersect() for every
+     * ray. <tt>hit[i]</tt> is set to whether ray \c i hit anything, and
+     * <tt>its[i]</tt> receives the details (unless \c shadowRay is set,
+     * in which case \c its may be \c nullptr).
+     */
+    void rayIntersect(uint32_t count, const Ray3f *rays, Intersection *its,
+        bool *hit, bool shadowRay = false, uint32_t interleave = 8) const;
+
     /// Return the total number of meshes registered with the BVH
     uint32_t getMeshCount() const { return (uint32_t) m_meshes.size(); }
 
@@ -123,6 +145,29 @@ protected:
     /// Compute internal tree statistics
     std::pair<float, uint32_t> statistics(uint32_t index = 0) const;
 
+    /// State of a suspended BVH traversal (see \ref step())
+    struct Traversal {
+        Ray3f ray;
+        uint32_t node, stackIdx, stack[64];
+        uint32_t f;       ///< Closest triangle found so far
+        uint32_t index;   ///< Index of the ray within its batch
+        bool found;
+        Intersection its;
+    };
+
+    /// Start the traversal of a ray; return \c false if it can't hit anything
+    bool begin(Traversal &t, const Ray3f &ray) const;
+
+    /**
+     * \brief Visit the next node of a traversal
+     *
+     * \return \c false when the traversal is complete
+     */
+    bool step(Traversal &t, bool shadowRay) const;
+
+    /// Fill in the details of an intersection with triangle \c f
+    void finalize(Intersection &its, uint32_t f) const;
+
     /* BVH node in 32 bytes */
     struct BVHNode {
         union {
@@ -11,6 +11,26 @@
 
 NORI_NAMESPACE_BEGIN
 
+/// Settings for writing OpenEXR files
+struct EXROptions {
+    /// Compression codecs (numbered like \c Imf::Compression)
+    enum ECompression {
+        ENone = 0, ERLE, EZIPS, EZIP, EPIZ, EPXR24, EB44, EB44A, EDWAA, EDWAB
+    };
+
+    /// Compression codec. Default: ZIP (lossless)
+    ECompression compression = EZIP;
+
+    /// Store 16-bit half precision values instead of 32-bit floats
+    bool half = false;
+
+    /// Number of threads that compress the file. Default: 0 (one per core)
+    int threadCount = 0;
+
+    /// Look up a codec by name (e.g. "piz"), throws a \ref NoriException if unknown
+    static ECompression parseCompression(const std::string &name);
+};
+
 /**
  * \brief Stores a RGB high dynamic-range bitmap
  *
@@ -32,10 +52,26 @@ public:
     /// Load an OpenEXR file with the specified filename
     Bitmap(const std::string &filename);
 
-    /// Save the bitmap as an EXR file with the specified filename
-    void saveEXR(const std::string &filename);
+    /**
+     * \brief Save the bitmap as an EXR file with the specified filename
+     *
+     * If the bitmap only holds a region (e.g. a crop window) of a larger
+     * image, \c offset and \c imageSize specify its position and the size
+     * of the full image, which become the data window and display window
+     * of the file. By default, the bitmap covers the entire image.
+     *
+     * Compression runs on \c options.threadCount threads.
+     */
+    void saveEXR(const std::string &filename, const Point2i &offset = Point2i(0, 0),
+                 const Vector2i &imageSize = Vector2i(0, 0),
+                 const EXROptions &options = EXROptions());
 
-    /// Save the bitmap as a PNG file (with sRGB tonemapping) with the specified filename
+    /**
+     * \brief Save the bitmap as a PNG file (with sRGB tonemapping) with the specified filename
+     *
+     * The conversion to 8-bit sRGB runs in parallel and uses a table
+     * instead of evaluating the sRGB curve for every pixel.
+     */
     void savePNG(const std::string &filename);
 };
 
@@ -12,9 +12,13 @@
 
 #include <nori/color.h>
 #include <nori/vector.h>
-#include <tbb/mutex.h>
+#include <tbb/spin_mutex.h>
+#include <atomic>
+#include <memory>
 
-#define NORI_BLOCK_SIZE 32 /* Block size used for parallelization */
+#define NORI_BLOCK_SIZE 32 /* Default block size used for parallelization */
+#define NORI_STRIPE_HEIGHT 8 /* Number of rows that share a lock in ImageBlock::put() */
+#define NORI_SPLAT_BATCH 16  /* Maximum number of samples that are splatted together (multiple of 4) */
 
 NORI_NAMESPACE_BEGIN
 
@@ -31,9 +35,18 @@ NORI_NAMESPACE_BEGIN
  * this region. For that reason, this class also stores information about
  * a small border region around the rectangle, whose size depends on the
  * properties of the reconstruction filter.
+ *
+ * Blocks that many threads merge their results into are protected by one
+ * lock per horizontal stripe of \c NORI_STRIPE_HEIGHT rows, so that
+ * threads only wait for each other when they write to the same rows.
+ * Each stripe also records the range of columns that were merged into
+ * since the last \ref snapshotChanges(), so that a preview only needs to
+ * copy what actually changed.
  */
 class ImageBlock : public Eigen::Array<Color4f, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> {
 public:
+    typedef Eigen::Array<Color4f, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> Base;
+
     /**
      * Create a new image block of the specified maximum size
      * \param size
@@ -66,36 +79,125 @@ public:
      * \brief Turn the block into a proper bitmap
      * 
      * This entails normalizing all pixels and discarding
-     * the border region.
+     * the border region. The rows are processed in parallel.
      */
     Bitmap *toBitmap() const;
 
     /// Convert a bitmap into an image block
     void fromBitmap(const Bitmap &bitmap);
 
+    /**
+     * \brief Save the unnormalized pixels as an OpenEXR file
+     *
+     * The file stores the weighted color sums in the R, G, B channels and
+     * the accumulated filter weights in a W channel. Dividing by W yields
+     * the same image as \ref toBitmap(). The weighted files of several
+     * renders of the same image can be added up using \ref addWeightedEXR().
+     *
+     * The display window of the file covers the full image of size
+     * \c imageSize, and the data window covers the block including the
+     * parts of its border that lie inside the image. Since the border
+     * holds the contributions of samples inside the block to neighboring
+     * pixels, adding up the files of adjacent blocks (e.g. crop windows)
+     * reproduces the image of a single render.
+     */
+    void saveWeightedEXR(const std::string &filename, const Vector2i &imageSize) const;
+
+    /**
+     * \brief Add the pixels of a file written by \ref saveWeightedEXR()
+     *
+     * The data window of the file must lie within the block (including
+     * its border).
+     */
+    void addWeightedEXR(const std::string &filename);
+
     /// Clear all contents
-    void clear() { setConstant(Color4f()); }
+    void clear() { setConstant(Color4f()); markChanged(); }
+
+    /**
+     * \brief Clear all contents, taking the stripe locks one at a time
+     *
+     * Like \ref clear(), but safe while other threads take snapshots of
+     * the block (e.g. when an interactive render restarts).
+     */
+    void clearLocked();
 
     /// Record a sample with the given position and radiance value
-    void put(const Point2f &pos, const Color3f &value);
+    void put(const Point2f &pos, const Color3f &value) { put(1, &pos, &value); }
+
+    /**
+     * \brief Record several samples at once
+     *
+     * Consecutive samples with overlapping footprints (e.g. the samples
+     * of one pixel) are splatted together in groups of up to
+     * \c NORI_SPLAT_BATCH: their filter weights are looked up four at a
+     * time using SIMD instructions, and each pixel of the combined
+     * footprint is only updated once.
+     */
+    void put(size_t count, const Point2f *positions, const Color3f *values);
+
+    /**
+     * \brief Record a sample that only contributes to a single pixel
+     *
+     * This is used when the position of the sample was importance sampled
+     * from the reconstruction filter (see \ref FilterSampler), in which
+     * case \c weight is the filter value divided by the sample density.
+     * Such blocks don't need a border, so they are created without a filter.
+     */
+    void put(const Point2i &pixel, const Color3f &value, float weight) {
+        if (!value.isValid()) {
+            cerr << "Integrator: computed an invalid radiance value: " << value.toString() << endl;
+            return;
+        }
+        coeffRef(pixel.y() - m_offset.y() + m_borderSize, pixel.x() - m_offset.x() + m_borderSize)
+            += Color4f(value.r() * weight, value.g() * weight, value.b() * weight, weight);
+    }
 
     /**
      * \brief Merge another image block into this one
      *
-     * During the merge operation, this function locks 
-     * the destination block using a mutex.
+     * During the merge operation, this function locks the
+     * affected stripes of the destination block one at a time.
      */
     void put(ImageBlock &b);
 
-    /// Lock the image block (using an internal mutex)
-    inline void lock() const { m_mutex.lock(); }
-    
-    /// Unlock the image block
-    inline void unlock() const { m_mutex.unlock(); }
+    /**
+     * \brief Copy the contents (including the border) into \c target
+     *
+     * This takes the stripe locks one at a time, so that e.g. a preview
+     * can read a consistent copy of every pixel without stalling the
+     * threads that merge into other parts of the block.
+     */
+    void snapshot(Base &target) const;
+
+    /**
+     * \brief Copy the pixels that changed since the last call into \c target
+     *
+     * Like \ref snapshot(), but only the columns of each stripe that were
+     * merged into since the previous call are copied (everything, if
+     * \c target doesn't have the size of the block yet). The changed
+     * regions are returned in \c changed, in pixel coordinates of the
+     * block including its border, with adjacent stripes combined.
+     *
+     * Meant for a single consumer, such as the preview window.
+     */
+    void snapshotChanges(Base &target, std::vector<BoundingBox2i> &changed) const;
+
+    /// Mark the entire block as changed (see \ref snapshotChanges())
+    void markChanged();
 
     /// Return a human-readable string summary
     std::string toString() const;
 protected:
+    /**
+     * \brief Splat a group of samples whose (clipped) footprints lie in \c bbox
+     *
+     * The positions are given in the coordinates of the block (including
+     * the border), relative to the pixel centers.
+     */
+    void splat(int count, const Point2f *positions, const Color4f *values,
+               const BoundingBox2i &bbox);
+
     Point2i m_offset;
     Vector2i m_size;
     int m_borderSize = 0;
@@ -104,7 +206,15 @@ protected:
     float *m_weightsX = nullptr;
     float *m_weightsY = nullptr;
     float m_lookupFactor = 0;
-    mutable tbb::mutex m_mutex;
+    int m_footprintSize = 0;
+    int m_stripeCount = 0;
+    std::unique_ptr<tbb::spin_mutex[]> m_stripes;
+
+    /// Range of columns [begin, end) of a stripe that changed
+    struct ChangedSpan {
+        int begin = 0, end = 0;
+    };
+    mutable std::unique_ptr<ChangedSpan[]> m_changed;
 };
 
 /**
@@ -114,41 +224,64 @@ protected:
  * rectangular blocks suitable for parallel rendering. The blocks
  * are ordered in spiraling pattern so that the center is
  * rendered first.
+ *
+ * The order is computed once up front. Handing out a block then only
+ * takes an atomic increment, so render threads never wait for each
+ * other, and consecutive blocks are still spatially adjacent.
  */
 class BlockGenerator {
 public:
     /**
      * \brief Create a block generator with
      * \param size
-     *      Size of the image that should be split into blocks
+     *      Size of the image region that should be split into blocks
      * \param blockSize
      *      Maximum size of the individual blocks
+     * \param offset
+     *      Offset of the region within the image (e.g. a crop window)
      */
-    BlockGenerator(const Vector2i &size, int blockSize);
+    BlockGenerator(const Vector2i &size, int blockSize,
+                   const Point2i &offset = Point2i(0, 0));
     
     /**
      * \brief Return the next block to be rendered
      *
-     * This function is thread-safe
+     * This function is thread-safe and lock-free
      *
      * \return \c false if there were no more blocks
      */
     bool next(ImageBlock &block);
 
+    /// Like \ref next(), but only return the offset and size of the block
+    bool next(Point2i &offset, Vector2i &size);
+
+    /// Restart from the center block (e.g. for another rendering pass)
+    void reset() { m_next = 0; }
+
     /// Return the total number of blocks
-    int getBlockCount() const { return m_blocksLeft; }
+    int getBlockCount() const { return (int) m_order.size(); }
+
+    /// Return the maximum size of the individual blocks
+    int getBlockSize() const { return m_blockSize; }
+
+    /**
+     * \brief Choose a block size for an image of the given size
+     *
+     * Blocks should be large to keep per-block overheads low, but there
+     * need to be enough of them so that all threads stay busy until the
+     * end. This returns the largest power of two between 8 and 64 that
+     * yields at least 16 blocks per thread.
+     */
+    static int autoBlockSize(const Vector2i &size, int threadCount);
 protected:
     enum EDirection { ERight = 0, EDown, ELeft, EUp };
 
-    Point2i m_block;
     Vector2i m_numBlocks;
     Vector2i m_size;
+    Point2i m_offset;
     int m_blockSize;
-    int m_numSteps;
-    int m_blocksLeft;
-    int m_stepsLeft;
-    int m_direction;
-    tbb::mutex m_mutex;
+    std::vector<Point2i> m_order;
+    std::atomic<int> m_next;
 };
 
 NORI_NAMESPACE_END
@@ -48,9 +48,45 @@ public:
     /// Return the size of the output image in pixels
     const Vector2i &getOutputSize() const { return m_outputSize; }
 
+    /// Return the offset of the crop window (the region of the image that is rendered)
+    const Point2i &getCropOffset() const { return m_cropOffset; }
+
+    /// Return the size of the crop window
+    const Vector2i &getCropSize() const { return m_cropSize; }
+
+    /// Restrict rendering to a region of the output image
+    void setCropWindow(const Point2i &offset, const Vector2i &size) {
+        if ((offset.array() < 0).any() || (size.array() <= 0).any() ||
+            ((offset + size).array() > m_outputSize.array()).any())
+            throw NoriException("Crop window [%s, %s] does not fit into an image of size %s",
+                                offset.toString(), size.toString(), m_outputSize.toString());
+        m_cropOffset = offset;
+        m_cropSize = size;
+    }
+
     /// Return the camera's reconstruction filter in image space
     const ReconstructionFilter *getReconstructionFilter() const { return m_rfilter; }
 
+    /// Return the camera-to-world transformation
+    virtual Transform getCameraToWorld() const {
+        throw NoriException("%s: camera does not have a transformation", toString());
+    }
+
+    /// Move the camera (e.g. between two renders of the same scene)
+    virtual void setCameraToWorld(const Transform &) {
+        throw NoriException("%s: camera can't be moved", toString());
+    }
+
+    /// Return the horizontal field of view in degrees
+    virtual float getFov() const {
+        throw NoriException("%s: camera does not have a field of view", toString());
+    }
+
+    /// Change the horizontal field of view (in degrees)
+    virtual void setFov(float) {
+        throw NoriException("%s: camera does not support changing the field of view", toString());
+    }
+
     /**
      * \brief Return the type of object (i.e. Mesh/Camera/etc.) 
      * provided by this instance
@@ -58,6 +94,8 @@ public:
     EClassType getClassType() const { return ECamera; }
 protected:
     Vector2i m_outputSize;
+    Point2i m_cropOffset = Point2i(0, 0);
+    Vector2i m_cropSize = Vector2i(0, 0);
     ReconstructionFilter *m_rfilter;
 };
 
@@ -0,0 +1,59 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#pragma once
+
+#include <nori/block.h>
+
+NORI_NAMESPACE_BEGIN
+
+class VarianceBuffer;
+
+/**
+ * \brief Saved state of an interrupted progressive render
+ *
+ * Checkpoints are taken between the passes of a progressive render, when
+ * every pixel has received the same number of samples (or, with adaptive
+ * sampling, the number recorded in the \ref VarianceBuffer). The file
+ * stores the accumulated image block including its weights and border,
+ * the error estimates of adaptive sampling, and the number of completed
+ * samples per pixel. The latter is also the sample offset of the next
+ * pass, from which the samplers derive their seeds, so that a resumed
+ * render continues with fresh samples.
+ */
+struct Checkpoint {
+    /// Number of samples per pixel rendered so far
+    uint32_t samplesDone = 0;
+
+    /// Number of samples per pixel the render aims for
+    uint32_t sampleTarget = 0;
+
+    /**
+     * \brief Write a checkpoint
+     *
+     * The data is written to a temporary file that then replaces
+     * \c filename, so that an interruption while saving never destroys
+     * the previous checkpoint.
+     */
+    void save(const std::string &filename, const ImageBlock &result,
+              const VarianceBuffer *variance) const;
+
+    /**
+     * \brief Restore a checkpoint into \c result (and \c variance)
+     *
+     * Throws a \ref NoriException if the file does not match the image
+     * size, crop window, filter, or sampling mode of the current render.
+     *
+     * \return \c false if the file does not exist
+     */
+    bool load(const std::string &filename, ImageBlock &result,
+              VarianceBuffer *variance);
+
+    /// Return a human-readable string summary
+    std::string toString() const;
+};
+
+NORI_NAMESPACE_END
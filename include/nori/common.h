@@ -114,6 +114,7 @@ class Integrator;
 class KDTree;
 class Emitter;
 struct EmitterQueryRecord;
+struct Intersection;
 class Mesh;
 class NoriObject;
 class NoriObjectFactory;
@@ -183,4 +183,188 @@ private:
     bool m_normalized;
 };
 
+/**
+ * \brief Discrete probability distribution with constant-time sampling
+ *
+ * Serves the same purpose as \ref DiscretePDF, but converts the entries
+ * into an alias table (using Vose's method) when \ref build() is called.
+ * Drawing a sample then only needs a single table lookup instead of a
+ * binary search over the CDF, which matters for emitters that consist of
+ * many triangles and are sampled at every shading point.
+ *
+ * \ingroup libcore
+ */
+struct AliasTable {
+public:
+    /// Create an empty table
+    AliasTable() { clear(); }
+
+    /// Clear all entries
+    void clear() {
+        m_pmf.clear();
+        m_threshold.clear();
+        m_alias.clear();
+        m_sum = 0.0f;
+        m_normalization = 0.0f;
+    }
+
+    /**
+     * \brief Build the alias table from a list of (unnormalized) weights
+     *
+     * \return Sum of the weights
+     */
+    float build(const std::vector<float> &weights) {
+        size_t n = weights.size();
+        clear();
+        m_pmf.resize(n);
+        m_threshold.resize(n);
+        m_alias.resize(n);
+
+        double sum = 0.0;
+        for (float w : weights)
+            sum += w;
+        m_sum = (float) sum;
+        if (n == 0 || sum <= 0)
+            return m_sum;
+        m_normalization = (float) (1.0 / sum);
+
+        /* Partition the scaled probabilities into entries that
+           are below ('small') and above ('large') the average */
+        std::vector<double> scaled(n);
+        std::vector<uint32_t> small, large;
+        for (size_t i = 0; i < n; ++i) {
+            m_pmf[i] = (float) (weights[i] / sum);
+            scaled[i] = weights[i] * n / sum;
+            (scaled[i] < 1.0 ? small : large).push_back((uint32_t) i);
+        }
+
+        /* Pair each underfull entry with an overfull one */
+        while (!small.empty() && !large.empty()) {
+            uint32_t i = small.back(), j = large.back();
+            small.pop_back();
+            m_threshold[i] = (float) scaled[i];
+            m_alias[i] = j;
+            scaled[j] -= 1.0 - scaled[i];
+            if (scaled[j] < 1.0) {
+                large.pop_back();
+                small.push_back(j);
+            }
+        }
+
+        /* Whatever remains is (up to roundoff) exactly full */
+        for (uint32_t i : small) {
+            m_threshold[i] = 1.0f;
+            m_alias[i] = i;
+        }
+        for (uint32_t i : large) {
+            m_threshold[i] = 1.0f;
+            m_alias[i] = i;
+        }
+
+        return m_sum;
+    }
+
+    /// Return the number of entries
+    size_t size() const {
+        return m_pmf.size();
+    }
+
+    /// Return the probability of the given entry
+    float operator[](size_t entry) const {
+        return m_pmf[entry];
+    }
+
+    /// Return the original (unnormalized) sum of all entries
+    float getSum() const {
+        return m_sum;
+    }
+
+    /// Return the normalization factor (i.e. the inverse of \ref getSum())
+    float getNormalization() const {
+        return m_normalization;
+    }
+
+    /**
+     * \brief %Transform a uniformly distributed sample to the stored distribution
+     *
+     * \param[in] sampleValue
+     *     An uniformly distributed sample on [0,1]
+     * \return
+     *     The discrete index associated with the sample
+     */
+    size_t sample(float sampleValue) const {
+        return sampleReuse(sampleValue);
+    }
+
+    /**
+     * \brief %Transform a uniformly distributed sample to the stored distribution
+     *
+     * \param[in] sampleValue
+     *     An uniformly distributed sample on [0,1]
+     * \param[out] pdf
+     *     Probability value of the sample
+     * \return
+     *     The discrete index associated with the sample
+     */
+    size_t sample(float sampleValue, float &pdf) const {
+        size_t index = sample(sampleValue);
+        pdf = m_pmf[index];
+        return index;
+    }
+
+    /**
+     * \brief %Transform a uniformly distributed sample to the stored distribution
+     *
+     * The original sample is value adjusted so that it can be "reused".
+     *
+     * \param[in, out] sampleValue
+     *     An uniformly distributed sample on [0,1]
+     * \return
+     *     The discrete index associated with the sample
+     */
+    size_t sampleReuse(float &sampleValue) const {
+        size_t n = m_pmf.size();
+        float scaled = sampleValue * n;
+        size_t index = std::min((size_t) scaled, n - 1);
+        float u = std::min(scaled - index, 0.99999994f);
+
+        float threshold = m_threshold[index];
+        if (u < threshold) {
+            sampleValue = u / threshold;
+            return index;
+        } else {
+            sampleValue = (u - threshold) / (1.0f - threshold);
+            return m_alias[index];
+        }
+    }
+
+    /**
+     * \brief %Transform a uniformly distributed sample.
+     *
+     * The original sample is value adjusted so that it can be "reused".
+     *
+     * \param[in,out]
+     *     An uniformly distributed sample on [0,1]
+     * \param[out] pdf
+     *     Probability value of the sample
+     * \return
+     *     The discrete index associated with the sample
+     */
+    size_t sampleReuse(float &sampleValue, float &pdf) const {
+        size_t index = sampleReuse(sampleValue);
+        pdf = m_pmf[index];
+        return index;
+    }
+
+    /// Return a human-readable string summary
+    std::string toString() const {
+        return tfm::format("AliasTable[size=%i, sum=%f]", m_pmf.size(), m_sum);
+    }
+private:
+    std::vector<float> m_pmf;
+    std::vector<float> m_threshold;
+    std::vector<uint32_t> m_alias;
+    float m_sum, m_normalization;
+};
+
 NORI_NAMESPACE_END
@@ -7,9 +7,48 @@
 #pragma once
 
 #include <nori/object.h>
+#include <nori/ray.h>
 
 NORI_NAMESPACE_BEGIN
 
+/**
+ * \brief Convenience data structure used to pass multiple
+ * parameters to the evaluation and sampling routines in \ref Emitter
+ */
+struct EmitterQueryRecord {
+    /// Reference point that receives illumination
+    Point3f ref;
+
+    /// Sampled (or intersected) point on the emitter
+    Point3f p;
+
+    /// Surface normal at \c p
+    Normal3f n;
+
+    /// Unit direction from \c ref towards \c p
+    Vector3f wi;
+
+    /// Distance between \c ref and \c p
+    float dist;
+
+    /// Probability density of \c p with respect to solid angles at \c ref
+    float pdf;
+
+    /// Shadow ray from \c ref to \c p
+    Ray3f shadowRay;
+
+    /// Create a new record for sampling the emitter
+    EmitterQueryRecord(const Point3f &ref) : ref(ref), dist(0.f), pdf(0.f) { }
+
+    /// Create a new record for querying the emitter at a known position
+    EmitterQueryRecord(const Point3f &ref, const Point3f &p, const Normal3f &n)
+        : ref(ref), p(p), n(n), pdf(0.f) {
+        wi = p - ref;
+        dist = wi.norm();
+        wi /= dist;
+    }
+};
+
 /**
  * \brief Superclass of all emitters
  */
@@ -17,6 +56,30 @@ class Emitter : public NoriObject {
    public:
     virtual Color3f getRadiance() = 0;
 
+    /**
+     * \brief Sample a point on the emitter as seen from \c lRec.ref
+     *
+     * \param lRec    An emitter query record (only \c ref needs to be set)
+     * \param sample  A uniformly distributed sample on \f$[0,1]^2\f$
+     *
+     * \return The emitted radiance divided by the solid angle density of
+     *         the sample. A zero value means that sampling failed.
+     */
+    virtual Color3f sample(EmitterQueryRecord &lRec,
+                           const Point2f &sample) const = 0;
+
+    /// Evaluate the radiance emitted from \c lRec.p towards \c lRec.ref
+    virtual Color3f eval(const EmitterQueryRecord &lRec) const = 0;
+
+    /**
+     * \brief Compute the solid angle density of sampling \c lRec.p
+     * from \c lRec.ref using \ref sample()
+     *
+     * This is needed to combine emitter and BSDF sampling using
+     * multiple importance sampling.
+     */
+    virtual float pdf(const EmitterQueryRecord &lRec) const = 0;
+
 /**
      * \brief Return the type of object (i.e. Mesh/Emitter/etc.) 
      * provided by this instance
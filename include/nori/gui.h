@@ -6,21 +6,83 @@
 
 #pragma once
 
-#include <nori/common.h>
+#include <nori/block.h>
+#include <nori/bbox.h>
+#include <nori/transform.h>
 #include <nanogui/screen.h>
+#include <functional>
 
 NORI_NAMESPACE_BEGIN
 
+/**
+ * \brief Preview window that displays an image block while it is rendered
+ *
+ * Every frame, only the regions of the block that changed since the last
+ * frame are copied (see \ref ImageBlock::snapshotChanges()) and uploaded
+ * to the texture. Images that don't fit on the screen are downsampled on
+ * the CPU by an integer factor before the upload.
+ *
+ * With \ref enableNavigation(), the camera can be moved using the mouse
+ * (drag to look around, scroll to zoom) and the keyboard (W/A/S/D to move,
+ * Q/E to move down/up).
+ */
 class NoriScreen : public nanogui::Screen {
 public:
+    /// Called with the new camera-to-world transformation and field of view
+    typedef std::function<void(const Transform &, float)> NavigationCallback;
+
     NoriScreen(const ImageBlock &block);
     void draw_contents() override;
+
+    /**
+     * \brief Let the user move the camera
+     *
+     * \param cameraToWorld
+     *     Initial camera-to-world transformation
+     * \param fov
+     *     Initial field of view (in degrees)
+     * \param moveSpeed
+     *     Distance that a key press moves the camera
+     * \param callback
+     *     Invoked (on the GUI thread) whenever the camera changes
+     */
+    void enableNavigation(const Transform &cameraToWorld, float fov, float moveSpeed,
+                          const NavigationCallback &callback);
+
+    bool mouse_motion_event(const nanogui::Vector2i &p, const nanogui::Vector2i &rel,
+                            int button, int modifiers) override;
+    bool scroll_event(const nanogui::Vector2i &p, const nanogui::Vector2f &rel) override;
+    bool keyboard_event(int key, int scancode, int action, int modifiers) override;
 private:
+    /// Report the current camera to the navigation callback
+    void updateCamera();
+
+    /// Return the factor by which an image must be downsampled to fit on the screen
+    static int previewDownsampling(const Vector2i &size);
+
+    /// Return the size of the window for the given image block
+    static nanogui::Vector2i windowSize(const ImageBlock &block);
+
+    /// Downsample a changed region of the snapshot and upload it to the texture
+    void upload(const BoundingBox2i &region);
+
     const ImageBlock &m_block;
+    ImageBlock::Base m_snapshot;
+    std::vector<BoundingBox2i> m_changed;
+    std::vector<float> m_upload;
+    int m_downsample = 1;
+    Vector2i m_textureSize;
+    Vector2i m_viewSize;
     nanogui::ref<nanogui::Shader> m_shader;
     nanogui::ref<nanogui::Texture> m_texture;
     nanogui::ref<nanogui::RenderPass> m_renderPass;
     float m_scale = 1.f;
+
+    /* Camera navigation */
+    NavigationCallback m_navigationCallback;
+    Vector3f m_origin, m_forward, m_up;
+    Transform m_handedness;
+    float m_fov = 0, m_moveSpeed = 0;
 };
 
 NORI_NAMESPACE_END
@@ -7,10 +7,32 @@
 #pragma once
 
 #include <nori/object.h>
+#include <nori/ray.h>
 #include <pcg32.h>
 
 NORI_NAMESPACE_BEGIN
 
+/**
+ * \brief Outcome of shading a single path vertex
+ *
+ * See \ref Integrator::shade()
+ */
+struct ShadingRecord {
+    /// Is there a shadow ray (i.e. a direct illumination estimate)?
+    bool shadow = false;
+    /// Shadow ray towards a sampled emitter position
+    Ray3f shadowRay;
+    /// Radiance towards the previous vertex if \c shadowRay is unoccluded
+    Color3f shadowValue = 0.f;
+
+    /// Should the path be continued?
+    bool extend = false;
+    /// Extension ray
+    Ray3f ray;
+    /// Throughput weight of the extension ray
+    Color3f weight = 0.f;
+};
+
 // parameters needed in integrator
 /**
  * \brief Abstract integrator (i.e. a rendering technique)
@@ -44,6 +66,27 @@ public:
     // normals, simple, ao(needs rng to maintain the randomness)
     virtual Color3f Li(const Scene *scene, Sampler *sampler, const Ray3f &ray) const = 0;
 
+    /**
+     * \brief Shade a single path vertex without tracing any rays (optional)
+     *
+     * Integrators that implement this function can be used by the
+     * wavefront renderer, which intersects and shades large batches of
+     * rays in separate stages. Instead of tracing them right away, the
+     * shadow ray and extension ray of the vertex are returned in \c sRec.
+     *
+     * \param ray
+     *    The ray that led to the vertex
+     * \param its
+     *    The intersection of \c ray with the scene
+     */
+    virtual void shade(const Scene *scene, Sampler *sampler, const Ray3f &ray,
+                       const Intersection &its, ShadingRecord &sRec) const {
+        throw NoriException("Integrator::shade(): not implemented!");
+    }
+
+    /// Does the integrator implement \ref shade()?
+    virtual bool supportsWavefront() const { return false; }
+
     /**
      * \brief Return the type of object (i.e. Mesh/BSDF/etc.)
      * provided by this instance
@@ -0,0 +1,139 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#pragma once
+
+#include <nori/mesh.h>
+#include <unordered_map>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Spatial, directional, and power bounds of a set of emitters
+ *
+ * Stores an axis-aligned bounding box, the total emitted power, and a
+ * cone (axis \c w and cosine of the spread angle \c cosTheta_o) that
+ * contains all surface normals. \c cosTheta_e bounds the angle beyond
+ * the normal cone into which light is still emitted (cos(pi/2) = 0 for
+ * one-sided area lights).
+ */
+struct LightBounds {
+    BoundingBox3f bbox;
+    Vector3f w = Vector3f(0.f, 0.f, 1.f);
+    float phi = 0.f;
+    float cosTheta_o = 1.f;
+    float cosTheta_e = 0.f;
+
+    /**
+     * \brief Conservatively estimate the contribution of the bounded
+     * emitters to a receiver at \c p with surface normal \c n
+     *
+     * The estimate is zero only if none of the emitters can illuminate
+     * the receiver, which is what keeps sampling with it unbiased.
+     */
+    float importance(const Point3f &p, const Normal3f &n) const;
+
+    /// Return the union of two bounds
+    static LightBounds merge(const LightBounds &a, const LightBounds &b);
+
+    /// Return a human-readable string summary
+    std::string toString() const;
+};
+
+/**
+ * \brief Bounding volume hierarchy over emissive triangles
+ *
+ * Every leaf of the hierarchy references a single emissive triangle (or
+ * a few of them when they cannot be separated). Inner nodes store the
+ * \ref LightBounds of their subtree. Sampling descends from the root and
+ * randomly picks a child proportional to its estimated importance for
+ * the receiver, so the cost of choosing a light is logarithmic in the
+ * number of emissive triangles, and a single shadow ray suffices no
+ * matter how many emitters the scene contains.
+ *
+ * The tree is built with the surface area orientation heuristic from
+ * "Importance Sampling of Many Lights With Adaptive Tree Splitting"
+ * by Alejandro Conty Estevez and Christopher Kulla (HPG 2018).
+ */
+class LightBVH {
+public:
+    /// Create an empty hierarchy
+    LightBVH() { }
+
+    /// Release all resources
+    void clear();
+
+    /// Build the hierarchy over all triangles of the given emitter meshes
+    void build(const std::vector<Mesh *> &emitters);
+
+    /// Return the number of emissive triangles
+    uint32_t getLightCount() const { return (uint32_t) m_lights.size(); }
+
+    /**
+     * \brief Choose an emissive triangle proportional to its estimated
+     * contribution at a receiver
+     *
+     * \param p
+     *    Position of the receiver
+     * \param n
+     *    Surface normal of the receiver
+     * \param sample
+     *    A uniformly distributed sample on \f$[0,1]\f$
+     * \param mesh
+     *    Upon success, the emitter mesh containing the chosen triangle
+     * \param triangle
+     *    Upon success, the index of the chosen triangle within \c mesh
+     * \param pmf
+     *    Upon success, the discrete probability of the choice
+     * \return
+     *    \c false if no emitter can illuminate the receiver
+     */
+    bool sample(const Point3f &p, const Normal3f &n, float sample,
+                const Mesh *&mesh, uint32_t &triangle, float &pmf) const;
+
+    /**
+     * \brief Return the probability that \ref sample() chooses the
+     * given triangle for a receiver at \c p with normal \c n
+     */
+    float pmf(const Point3f &p, const Normal3f &n, const Mesh *mesh,
+              uint32_t triangle) const;
+
+    /// Return a human-readable string summary
+    std::string toString() const;
+
+protected:
+    /// Reference to an emissive triangle
+    struct Light {
+        const Mesh *mesh;
+        uint32_t triangle;
+        LightBounds bounds;
+    };
+
+    /// Hierarchy node (leaves reference a range of \ref m_lights)
+    struct Node {
+        LightBounds bounds;
+        uint32_t index;     ///< Right child (inner nodes) or first light (leaves)
+        uint32_t count;     ///< Number of lights (0 for inner nodes)
+        bool isLeaf() const { return count > 0; }
+    };
+
+    /// Recursively build the subtree for the lights in [start, end)
+    uint32_t buildNode(uint32_t start, uint32_t end, uint64_t trail,
+                       int depth);
+
+    /// Choose among the lights of a leaf proportional to their importance
+    int sampleLeaf(const Node &node, const Point3f &p, const Normal3f &n,
+                   float sample, float &pmf) const;
+
+private:
+    std::vector<Light> m_lights;      ///< Emissive triangles (in tree order)
+    std::vector<Node> m_nodes;        ///< Nodes in depth-first order
+    std::vector<uint64_t> m_trail;    ///< Root-to-leaf path of each light
+    std::vector<uint32_t> m_lightIdx; ///< Maps emitter triangles to m_lights
+    std::unordered_map<const Mesh *, uint32_t> m_meshOffset;
+};
+
+NORI_NAMESPACE_END
@@ -139,15 +139,57 @@ class Mesh : public NoriObject {
     /// Register a child object (e.g. a BSDF) with the mesh
     virtual void addChild(NoriObject *child);
 
+    /**
+     * \brief Replace the BSDF or the area emitter of the mesh
+     *
+     * This is used when the scene file is reloaded (see \ref SceneReloader).
+     * The previous instance is released.
+     */
+    void replaceChild(NoriObject *child);
+
     /// Return the name of this mesh
     const std::string &getName() const { return m_name; }
 
+    /// Return the total surface area (only available for emitters)
+    float getSurfaceArea() const { return m_surfaceArea; }
+
+    /**
+     * \brief Sample a position uniformly on the surface of the mesh
+     *
+     * A triangle is chosen proportional to its surface area using a table
+     * that is precomputed in \ref activate(), and a point is then sampled
+     * uniformly on it. Both steps take constant time. The sampling tables
+     * are only built for meshes with an attached emitter.
+     *
+     * \param sample
+     *    A uniformly distributed sample on \f$[0,1]^2\f$
+     * \param p
+     *    Upon return, the sampled position
+     * \param n
+     *    Upon return, the (interpolated) surface normal at \c p
+     * \return
+     *    The probability density of the sample with respect to area
+     */
+    float samplePosition(const Point2f &sample, Point3f &p,
+                         Normal3f &n) const;
 
+    /// Return the density of \ref samplePosition() with respect to area
+    float pdfPosition() const { return m_invSurfaceArea; }
 
-    // Pick a triangle proportional to its surface area,
-    // and sample a point on the triangle. Return Pdf.
-    float samplePosition(Point2f random, Point3f &sample,
-                        Normal3f &normal);
+    /**
+     * \brief Sample a position uniformly on a single triangle
+     *
+     * \param index
+     *    Index of the triangle
+     * \param sample
+     *    A uniformly distributed sample on \f$[0,1]^2\f$
+     * \param p
+     *    Upon return, the sampled position
+     * \param n
+     *    Upon return, the (interpolated) surface normal at \c p
+     */
+    void sampleTriangle(uint32_t index, const Point2f &sample, Point3f &p,
+                        Normal3f &n) const;
 
     /// Return a human-readable summary of this instance
     std::string toString() const;
@@ -176,7 +218,9 @@ class Mesh : public NoriObject {
     BSDF *m_bsdf = nullptr;        ///< BSDF of the surface
     Emitter *m_emitter = nullptr;  ///< Associated emitter, if any
     BoundingBox3f m_bbox;          ///< Bounding box of the mesh
-    DiscretePDF m_dpdf;            ///< Discrete PDF of this mesh
+    AliasTable m_areaTable;        ///< Triangle areas (emitters only)
+    float m_surfaceArea = 0;       ///< Total surface area (emitters only)
+    float m_invSurfaceArea = 0;    ///< Inverse of \ref m_surfaceArea
 };
 
 NORI_NAMESPACE_END
@@ -129,9 +129,13 @@ public:
      */
     static NoriObject *createInstance(const std::string &name,
             const PropertyList &propList) {
-        if (!m_constructors || m_constructors->find(name) == m_constructors->end())
-            throw NoriException("A constructor for class \"%s\" could not be found!", name);
-        return (*m_constructors)[name](propList);
+        /* Read-only lookup, so that the parser may call this concurrently */
+        if (m_constructors) {
+            auto it = m_constructors->find(name);
+            if (it != m_constructors->end())
+                return it->second(propList);
+        }
+        throw NoriException("A constructor for class \"%s\" could not be found!", name);
     }
 private:
     static std::map<std::string, Constructor> *m_constructors;
@@ -16,4 +16,13 @@ NORI_NAMESPACE_BEGIN
  */
 extern NoriObject *loadFromXML(const std::string &filename);
 
+/**
+ * \brief Load an object (e.g. a scene, or a single BSDF) from an XML
+ * string and return it
+ *
+ * \c filename is only used in error messages.
+ */
+extern NoriObject *loadFromXMLString(const std::string &xml,
+                                     const std::string &filename = "<string>");
+
 NORI_NAMESPACE_END
@@ -0,0 +1,104 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#pragma once
+
+#include <nori/common.h>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Building blocks of the quasi-Monte Carlo samplers
+ *
+ * Randomization relies on hashing instead of stored random numbers, so
+ * that the samples of any pixel can be computed on the fly, in any order.
+ */
+namespace qmc {
+    /// Reverse the order of the bits of a 32-bit integer
+    inline uint32_t reverseBits(uint32_t x) {
+        x = (x << 16) | (x >> 16);
+        x = ((x & 0x00ff00ff) << 8) | ((x & 0xff00ff00) >> 8);
+        x = ((x & 0x0f0f0f0f) << 4) | ((x & 0xf0f0f0f0) >> 4);
+        x = ((x & 0x33333333) << 2) | ((x & 0xcccccccc) >> 2);
+        x = ((x & 0x55555555) << 1) | ((x & 0xaaaaaaaa) >> 1);
+        return x;
+    }
+
+    /// Scramble the bits of a 32-bit integer (an invertible hash)
+    inline uint32_t mix(uint32_t x) {
+        x ^= x >> 16; x *= 0x7feb352d;
+        x ^= x >> 15; x *= 0x846ca68b;
+        x ^= x >> 16;
+        return x;
+    }
+
+    /// Combine a hash value with another value
+    inline uint32_t hash(uint32_t seed, uint32_t value) {
+        return mix(seed ^ (value + 0x9e3779b9 + (seed << 6) + (seed >> 2)));
+    }
+
+    /**
+     * \brief Owen scrambling of a 32-bit fixed-point number in [0, 1)
+     *
+     * Every bit is flipped depending on a hash of the bits above it,
+     * which randomizes a point set while keeping its stratification.
+     * This is the hash-based variant by Laine and Karras, with the
+     * improved constants of Burley ("Practical Hash-based Owen
+     * Scrambling", JCGT 2020).
+     */
+    inline uint32_t owenScramble(uint32_t x, uint32_t seed) {
+        x = reverseBits(x);
+        x += seed;
+        x ^= x * 0x6c50b47c;
+        x ^= x * 0xb82f1e52;
+        x ^= x * 0xc7afe638;
+        x ^= x * 0x8d22f6e6;
+        return reverseBits(x);
+    }
+
+    /// First dimension of the Sobol sequence (the van der Corput sequence)
+    inline uint32_t sobol0(uint32_t index) {
+        return reverseBits(index);
+    }
+
+    /// Second dimension of the Sobol sequence
+    inline uint32_t sobol1(uint32_t index) {
+        uint32_t result = 0;
+        for (uint32_t v = 1u << 31; index; index >>= 1, v ^= v >> 1)
+            if (index & 1)
+                result ^= v;
+        return result;
+    }
+
+    /**
+     * \brief Radical inverse of \c index in the given base, with the
+     * digits mapped through a permutation of <tt>0..base-1</tt>
+     *
+     * The infinitely many trailing zero digits are permuted as well,
+     * which the last term accounts for.
+     */
+    inline float scrambledRadicalInverse(uint32_t base, uint64_t index, const uint16_t *perm) {
+        double invBase = 1.0 / base, invBaseN = 1.0;
+        uint64_t reversedDigits = 0;
+        while (index) {
+            uint64_t next = index / base, digit = index - next * base;
+            reversedDigits = reversedDigits * base + perm[digit];
+            invBaseN *= invBase;
+            index = next;
+        }
+        double value = invBaseN * (reversedDigits + invBase * perm[0] / (1.0 - invBase));
+        return std::min((float) value, 0x1.fffffep-1f);
+    }
+
+    /// Convert a 32-bit fixed-point number to a float in [0, 1)
+    inline float toFloat(uint32_t x) {
+        /* Only keep as many bits as a float can represent, so that
+           rounding never produces 1 */
+        return (x >> 8) * (1.f / (1 << 24));
+    }
+};
+
+NORI_NAMESPACE_END
@@ -0,0 +1,79 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#pragma once
+
+#include <nori/object.h>
+#include <memory>
+
+namespace pugi { class xml_document; }
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Applies edits of a scene file to the loaded scene
+ *
+ * The reloader keeps the XML document that the scene was loaded from.
+ * When the file changes, the new document is compared against it, one
+ * top-level element of the scene at a time:
+ *
+ * - A changed camera, integrator or sampler is parsed on its own and
+ *   replaces the previous one (\ref Scene::replaceChild()).
+ * - A mesh whose BSDF or emitter changed, but not its geometry, keeps
+ *   its triangles and the BVH, and only receives the new BSDF or emitter
+ *   (\ref Mesh::replaceChild()).
+ * - Any other change (e.g. to the geometry, or added and removed
+ *   elements) reloads the entire scene.
+ *
+ * Changes must not alter the output size of the camera, or the border
+ * that its reconstruction filter needs, since the image that is being
+ * rendered can't be resized.
+ */
+class SceneReloader {
+public:
+    /// What a reload changed
+    enum EChange {
+        ENone = 0,   ///< Nothing that affects the image
+        ECamera,     ///< Only the camera; just the accumulation restarts
+        EShading,    ///< Materials, emitters, the integrator or the sampler
+        EScene       ///< The scene was loaded again from scratch
+    };
+
+    /// Remember the contents of the given scene file
+    SceneReloader(const std::string &filename);
+
+    ~SceneReloader();
+
+    /**
+     * \brief Check whether the file was modified since the last call
+     *
+     * Contents that failed to load are only reported once, so that the
+     * caller doesn't retry until the file is saved again.
+     */
+    bool poll();
+
+    /**
+     * \brief Parse the file again and apply the changes to \c root
+     *
+     * This may replace \c root entirely. Upon failure (e.g. a syntax error
+     * while the file is being edited), a \ref NoriException is thrown and
+     * the scene remains unchanged.
+     */
+    EChange reload(std::unique_ptr<NoriObject> &root);
+
+    /// Return a human-readable string summary
+    std::string toString() const;
+protected:
+    /// Return the current contents of the file
+    std::string read() const;
+
+    std::string m_filename;
+    std::string m_contents;
+    std::string m_polled;
+    std::unique_ptr<pugi::xml_document> m_doc;
+};
+
+NORI_NAMESPACE_END
@@ -7,10 +7,14 @@
 #pragma once
 
 #include <nori/object.h>
+#include <nori/dpdf.h>
 
 /// Reconstruction filters will be tabulated at this resolution
 #define NORI_FILTER_RESOLUTION 32
 
+/// Resolution of the tables used to importance sample reconstruction filters
+#define NORI_FILTER_SAMPLING_RESOLUTION 64
+
 NORI_NAMESPACE_BEGIN
 
 /**
@@ -42,4 +46,47 @@ protected:
     float m_radius;
 };
 
+/**
+ * \brief Importance sampling of a reconstruction filter
+ *
+ * Instead of splatting every sample over all pixels in the filter's
+ * support, the position of a sample relative to the center of a pixel can
+ * be drawn proportionally to the filter, after which the sample only
+ * contributes to that one pixel. Like the splatting code in
+ * \ref ImageBlock, this treats the filter as separable, and samples each
+ * axis from a tabulated (piecewise constant) version of \c |f|.
+ *
+ * Filters with negative lobes (e.g. Mitchell-Netravali) produce samples
+ * with negative weights, which are accumulated like any other filter
+ * weight.
+ */
+class FilterSampler {
+public:
+    /// Tabulate the given filter
+    FilterSampler(const ReconstructionFilter *filter);
+
+    /**
+     * \brief Sample an offset from the center of a pixel
+     *
+     * \param sample
+     *     A uniformly distributed sample on [0,1]^2
+     * \param weight
+     *     Filter value divided by the probability density of the offset
+     */
+    Point2f sample(const Point2f &sample, float &weight) const {
+        float sx = sample.x(), sy = sample.y();
+        size_t ix = m_pdf.sampleReuse(sx), iy = m_pdf.sampleReuse(sy);
+        weight = m_weights[ix] * m_weights[iy];
+        return Point2f((ix + sx) * m_binSize - m_radius, (iy + sy) * m_binSize - m_radius);
+    }
+
+    /// Return a human-readable string summary
+    std::string toString() const;
+protected:
+    DiscretePDF m_pdf;
+    std::vector<float> m_weights;
+    float m_radius;
+    float m_binSize;
+};
+
 NORI_NAMESPACE_END
@@ -32,7 +32,8 @@ class ImageBlock;
  *
  * The general interface between a sampler and a rendering algorithm is as 
  * follows: Before beginning to render a pixel, the rendering algorithm calls 
- * \ref generate(). The first pixel sample can now be computed, after which
+ * \ref generate() with the coordinates of the pixel. The first pixel sample
+ * can now be computed, after which
  * \ref advance() needs to be invoked. This repeats until all pixel samples have
  * been exhausted.  While computing a pixel sample, the rendering 
  * algorithm requests (pseudo-) random numbers using the \ref next1D() and
@@ -69,9 +70,10 @@ public:
      * \brief Prepare to generate new samples
      * 
      * This function is called initially and every time the 
-     * integrator starts rendering a new pixel.
+     * integrator starts rendering a new pixel. The first sample
+     * is the one with index \ref getSampleOffset().
      */
-    virtual void generate() = 0;
+    virtual void generate(const Point2i &pixel) = 0;
 
     /// Advance to the next sample
     virtual void advance() = 0;
@@ -85,6 +87,19 @@ public:
     /// Return the number of configured pixel samples
     virtual size_t getSampleCount() const { return m_sampleCount; }
 
+    /**
+     * \brief Set the index of the first pixel sample that will be
+     * requested after the next call to \ref prepare()
+     *
+     * Progressive rendering computes the samples of each pixel in several
+     * passes, and this index tells the sampler where the current pass
+     * starts. That way, each pass receives a different set of samples.
+     */
+    void setSampleOffset(size_t offset) { m_sampleOffset = offset; }
+
+    /// Return the index of the first pixel sample of the current pass
+    size_t getSampleOffset() const { return m_sampleOffset; }
+
     /**
      * \brief Return the type of object (i.e. Mesh/Sampler/etc.) 
      * provided by this instance
@@ -92,6 +107,7 @@ public:
     EClassType getClassType() const { return ESampler; }
 protected:
     size_t m_sampleCount;
+    size_t m_sampleOffset = 0;
 };
 
 NORI_NAMESPACE_END
@@ -103,6 +103,14 @@ class Scene : public NoriObject {
     /// Add a child object to the scene (meshes, integrators etc.)
     void addChild(NoriObject *obj);
 
+    /**
+     * \brief Replace the camera, integrator or sampler of the scene
+     *
+     * This is used when the scene file is reloaded (see \ref SceneReloader).
+     * The previous instance is released.
+     */
+    void replaceChild(NoriObject *obj);
+
     /// Return a string summary of the scene (for debugging purposes)
     std::string toString() const;
 
@@ -0,0 +1,147 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#pragma once
+
+#include <nori/block.h>
+#include <chrono>
+#include <memory>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Work-stealing scheduler for the image blocks of a rendering pass
+ *
+ * The blocks (or \a tiles) of a \ref BlockGenerator are handed out to the
+ * workers in order. A worker then claims the rows of its tile one at a
+ * time. Once the queue has drained, idle workers look for the piece of
+ * work with the most remaining rows and steal the second half of them,
+ * which becomes a new piece that can in turn be split again. That way,
+ * a few expensive tiles at the end of a pass no longer keep one or two
+ * threads busy while all others wait.
+ *
+ * The scheduler also measures how long each tile took. Subsequent passes
+ * (see \ref reset()) start with the most expensive tiles, and the busy
+ * times of all workers are summarized by \ref getUtilization().
+ *
+ * As long as nothing is stolen, a worker renders a complete tile using the
+ * same block offset as the plain \ref BlockGenerator, so samplers that are
+ * seeded per block produce the same image.
+ */
+class TileScheduler {
+public:
+    /**
+     * \brief Create a scheduler
+     * \param size
+     *      Size of the image that should be split into tiles
+     * \param blockSize
+     *      Maximum size of the individual tiles
+     * \param workerCount
+     *      Number of workers that will request work concurrently
+     * \param offset
+     *      Offset of the region within the image (e.g. a crop window)
+     */
+    TileScheduler(const Vector2i &size, int blockSize, int workerCount,
+                  const Point2i &offset = Point2i(0, 0));
+
+    /// Return the maximum size of the individual tiles
+    int getBlockSize() const { return m_blockSize; }
+
+    /// Return the number of workers
+    int getWorkerCount() const { return m_workerCount; }
+
+    /**
+     * \brief Prepare another pass over all tiles
+     *
+     * After the first pass, the tiles are ordered by decreasing cost as
+     * measured during the previous pass.
+     */
+    void reset();
+
+    /**
+     * \brief Acquire a piece of work
+     *
+     * Sets the offset and size of \c block to the region of the piece and
+     * returns its index. The rows of the piece must then be claimed using
+     * \ref nextRow(), and \ref done() must be called when no rows are left.
+     *
+     * \return The index of the piece, or -1 if the pass is complete
+     */
+    int next(int worker, ImageBlock &block);
+
+    /**
+     * \brief Claim the next row of a piece
+     *
+     * \param row
+     *      Upon success, the row relative to the offset of the block
+     *      that was configured by \ref next()
+     * \return \c false if no rows are left
+     */
+    bool nextRow(int piece, int &row);
+
+    /// Give up the remaining rows of a piece (e.g. if they need no work)
+    void skip(int piece);
+
+    /// Report that a worker has finished its current piece
+    void done(int worker, int piece);
+
+    /**
+     * \brief Summarize how busy the workers were over time
+     *
+     * The time since the creation of the scheduler is divided into
+     * \c slices intervals, and the fraction of time that the workers spent
+     * rendering is reported for each of them.
+     */
+    std::string getUtilization(int slices = 10) const;
+
+    /// Return a human-readable string summary
+    std::string toString() const;
+protected:
+    typedef std::chrono::steady_clock Clock;
+
+    /// Pack the range of remaining rows [next, end) into a single word
+    static uint64_t pack(uint32_t next, uint32_t end) { return ((uint64_t) next << 32) | end; }
+
+    /// Steal half of the remaining rows of the largest piece
+    int steal(ImageBlock &block);
+
+    /// Time in microseconds since the creation of the scheduler
+    int64_t now() const;
+
+    struct Tile {
+        Point2i offset;
+        Vector2i size;
+        int64_t cost = 0;                  ///< Time spent during the last pass (us)
+        std::atomic<int64_t> currentCost;  ///< Time spent during this pass (us)
+    };
+
+    struct Piece {
+        int tile = 0;
+        int begin = 0;                     ///< First row, relative to the tile
+        std::atomic<uint64_t> rows;        ///< Packed range of rows that remain
+    };
+
+    struct Worker {
+        int64_t start = 0;
+        std::vector<std::pair<int64_t, int64_t>> busy;
+    };
+
+    Vector2i m_size;
+    int m_blockSize;
+    int m_workerCount;
+    int m_tileCount;
+    int m_pieceCapacity;
+    std::unique_ptr<Tile[]> m_tiles;
+    std::unique_ptr<Piece[]> m_pieces;
+    std::vector<int> m_order;
+    std::vector<Worker> m_workers;
+    std::atomic<int> m_next;
+    std::atomic<int> m_pieceCount;
+    int m_passes = 0;
+    Clock::time_point m_start;
+};
+
+NORI_NAMESPACE_END
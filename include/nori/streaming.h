@@ -0,0 +1,109 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#pragma once
+
+#include <nori/block.h>
+#include <nori/bitmap.h>
+#include <tbb/mutex.h>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Writes a render to a tiled OpenEXR file while it is in progress
+ *
+ * Normally, the whole image is accumulated in a single \ref ImageBlock,
+ * which is then converted into a \ref Bitmap and written at the end. For
+ * very large images, this needs about twice the memory of the full frame.
+ *
+ * This class instead splits the image into tiles of the same size as the
+ * blocks of the \ref TileScheduler and only keeps the tiles that are
+ * still receiving samples in memory. Because of the reconstruction
+ * filter, a rendered block also contributes to the pixels of the
+ * neighboring tiles. A tile is therefore complete once it and all
+ * neighbors whose filter border overlaps it have been rendered. At that
+ * point, it is normalized, written to the file, and its memory is
+ * released. Since the blocks are rendered along a spiral, only the tiles
+ * along its boundary are in memory at any time.
+ */
+class StreamingOutput {
+public:
+    /**
+     * \brief Create the output file
+     *
+     * \param filename
+     *     Name of the OpenEXR file
+     * \param imageSize
+     *     Size of the full image (the display window of the file)
+     * \param offset
+     *     Offset of the rendered region, e.g. a crop window
+     * \param size
+     *     Size of the rendered region (the data window of the file)
+     * \param tileSize
+     *     Size of the tiles, which must match the block size of the scheduler
+     * \param filter
+     *     Reconstruction filter, which determines the border of the blocks
+     * \param options
+     *     Compression and precision of the file
+     */
+    StreamingOutput(const std::string &filename, const Vector2i &imageSize,
+                    const Point2i &offset, const Vector2i &size, int tileSize,
+                    const ReconstructionFilter *filter,
+                    const EXROptions &options = EXROptions());
+
+    /// Close the file
+    ~StreamingOutput();
+
+    /**
+     * \brief Add a rendered block (or a part of one)
+     *
+     * \c rows is the number of rows of the block's tile that were
+     * rendered. Tiles that become complete are written to the file.
+     * This function is thread-safe.
+     */
+    void put(const ImageBlock &block, int rows);
+
+    /// Return the number of tiles that have been written so far
+    int getWrittenTiles() const { return m_written; }
+
+    /// Return the largest number of tiles that were in memory at the same time
+    int getPeakTiles() const { return m_peakTiles; }
+
+    /// Return a human-readable string summary
+    std::string toString() const;
+protected:
+    struct Tile {
+        Point2i offset;
+        Vector2i size;
+        tbb::spin_mutex mutex;
+        std::unique_ptr<Color4f[]> pixels;  ///< Allocated on first use
+        std::atomic<int> rowsDone;          ///< Rendered rows of this tile
+        std::atomic<int> pending;           ///< Incomplete tiles that overlap this one
+    };
+
+    /// Return the tiles whose pixels are within the filter border of \c tile
+    void neighbors(int tile, std::vector<int> &result) const;
+
+    /// Normalize a complete tile, write it to the file, and release it
+    void write(int tile);
+
+    struct File;
+
+    Point2i m_offset;
+    Vector2i m_size;
+    int m_tileSize;
+    int m_borderSize;
+    bool m_half;
+    Vector2i m_tileCount;
+    std::unique_ptr<Tile[]> m_tiles;
+    std::unique_ptr<File> m_file;
+    tbb::mutex m_fileMutex;
+    std::atomic<int> m_written;
+    std::atomic<int> m_liveTiles;
+    std::atomic<int> m_peakTiles;
+};
+
+NORI_NAMESPACE_END
@@ -0,0 +1,84 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#pragma once
+
+#include <nori/block.h>
+#include <nori/bbox.h>
+#include <condition_variable>
+#include <thread>
+#include <mutex>
+
+/// Default address of the tev image viewer
+#define NORI_TEV_ADDRESS "127.0.0.1:14158"
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Sends a render in progress to the tev image viewer
+ *
+ * This is an alternative to the preview window (\ref NoriScreen) for
+ * machines without a display: tev can run elsewhere and be reached
+ * through e.g. an SSH tunnel. The client connects to tev via TCP and
+ * creates an image with the RGB channels of the block. A background
+ * thread then periodically copies the regions of the block that changed
+ * since its last visit (see \ref ImageBlock::snapshotChanges()) and
+ * sends them using tev's image update packets. The render threads
+ * themselves never wait for the network.
+ *
+ * If the connection breaks, a warning is printed and no further updates
+ * are sent; the render itself continues.
+ */
+class TevClient {
+public:
+    /**
+     * \brief Connect to tev and start sending updates
+     *
+     * \param address
+     *     Host and port of the viewer, e.g. \c NORI_TEV_ADDRESS
+     * \param name
+     *     Name of the image in the viewer
+     * \param block
+     *     The block that is being rendered
+     * \param interval
+     *     Time between two updates (in seconds)
+     *
+     * Throws a \ref NoriException if the viewer can't be reached.
+     */
+    TevClient(const std::string &address, const std::string &name,
+              const ImageBlock &block, float interval = 0.1f);
+
+    /// Send the final state of the block and disconnect
+    ~TevClient();
+
+    /// Return a human-readable string summary
+    std::string toString() const;
+protected:
+    /// Update loop of the background thread
+    void run();
+
+    /// Send the regions of the block that changed since the last call
+    bool sendChanges();
+
+    /// Send a packet, and return \c false if the connection broke
+    bool send(std::vector<char> &packet);
+
+    std::string m_address;
+    std::string m_name;
+    const ImageBlock &m_block;
+    float m_interval;
+    ImageBlock::Base m_snapshot;
+    std::vector<BoundingBox2i> m_changed;
+    std::vector<char> m_packet;
+    int m_socket = -1;
+    bool m_connected = false;
+    bool m_stop = false;
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::thread m_thread;
+};
+
+NORI_NAMESPACE_END
@@ -78,6 +78,12 @@ public:
 
     /// Return a string representation
     std::string toString() const;
+
+    /**
+     * \brief Create a camera-to-world transformation for a camera at
+     * \c origin that looks at \c target
+     */
+    static Transform lookAt(const Vector3f &origin, const Vector3f &target, const Vector3f &up);
 private:
     Eigen::Matrix4f m_transform;
     Eigen::Matrix4f m_inverse;
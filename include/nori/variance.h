@@ -0,0 +1,113 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#pragma once
+
+#include <nori/block.h>
+#include <iosfwd>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Per-pixel sample statistics for adaptive sampling
+ *
+ * For every pixel of the image, this buffer keeps a running mean and
+ * variance (Welford's method) of the luminance of all samples that
+ * landed inside it. These yield an estimate of the relative standard
+ * error of the pixel, and pixels whose error is still above a target
+ * are marked as \a active, i.e. in need of further samples.
+ *
+ * Samples are only recorded for the pixel that contains them (the
+ * reconstruction filter is ignored), so that a render thread working on
+ * an image block only ever touches the pixels inside of it. No locking
+ * is needed as long as different threads render disjoint blocks.
+ */
+class VarianceBuffer {
+public:
+    /**
+     * \brief Create a buffer with all pixels active
+     *
+     * The buffer covers the region of the given size and offset
+     * (e.g. a crop window) within the image.
+     */
+    VarianceBuffer(const Vector2i &size, const Point2i &offset = Point2i(0, 0));
+
+    /// Return the size of the covered region
+    const Vector2i &getSize() const { return m_size; }
+
+    /// Return the offset of the covered region
+    const Point2i &getOffset() const { return m_offset; }
+
+    /// Reset all statistics and mark all pixels active
+    void clear();
+
+    /// Record a sample of the given pixel
+    void put(const Point2i &pixel, const Color3f &value) {
+        Pixel &p = m_pixels[index(pixel)];
+        float lum = value.getLuminance();
+        float delta = lum - p.mean;
+        p.count += 1;
+        p.mean += delta / p.count;
+        p.m2 += delta * (lum - p.mean);
+    }
+
+    /// Return the number of samples recorded for a pixel
+    uint32_t getSampleCount(const Point2i &pixel) const {
+        return m_pixels[index(pixel)].count;
+    }
+
+    /// Return the relative standard error of a pixel's estimate
+    float getRelativeError(const Point2i &pixel) const;
+
+    /// Does the pixel need more samples?
+    bool isActive(const Point2i &pixel) const {
+        return m_active[index(pixel)] != 0;
+    }
+
+    /// Does any pixel of the given image block need more samples?
+    bool isActive(const ImageBlock &block) const;
+
+    /**
+     * \brief Decide which pixels need more samples
+     *
+     * A pixel remains active until it has at least \c minSamples samples
+     * and a relative error below \c threshold, or until it reaches
+     * \c maxSamples samples.
+     *
+     * \return The number of active pixels
+     */
+    size_t update(float threshold, uint32_t minSamples, uint32_t maxSamples);
+
+    /// Serialize the statistics (e.g. for a \ref Checkpoint)
+    void write(std::ostream &os) const;
+
+    /// Restore statistics that were written by \ref write()
+    void read(std::istream &is);
+
+    /// Return the per-pixel sample counts as a bitmap
+    Bitmap *toBitmap() const;
+
+    /// Return a human-readable string summary
+    std::string toString() const;
+protected:
+    /// Index of the given pixel (in image coordinates)
+    size_t index(const Point2i &pixel) const {
+        return (size_t) (pixel.y() - m_offset.y()) * m_size.x() + (pixel.x() - m_offset.x());
+    }
+
+    struct Pixel {
+        uint32_t count = 0;
+        float mean = 0.f;
+        float m2 = 0.f;
+    };
+
+    Vector2i m_size;
+    Point2i m_offset;
+    std::vector<Pixel> m_pixels;
+    std::vector<uint8_t> m_active;
+};
+
+NORI_NAMESPACE_END
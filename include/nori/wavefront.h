@@ -0,0 +1,124 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#pragma once
+
+#include <nori/integrator.h>
+#include <nori/mesh.h>
+#include <unordered_map>
+#include <memory>
+
+#define NORI_WAVEFRONT_BATCH 8192 /* Number of paths that are traced together */
+
+NORI_NAMESPACE_BEGIN
+
+class VarianceBuffer;
+class FilterSampler;
+
+/**
+ * \brief Wavefront renderer
+ *
+ * Instead of following one path at a time through recursive calls of
+ * \ref Integrator::Li(), this class traces a large batch of paths in
+ * stages that each run over the entire batch:
+ *
+ * 1. Generate: sample the camera rays of all queued pixel samples
+ * 2. Intersect: find the closest hit of every ray in the queue
+ * 3. Sort: order the hits by their BSDF
+ * 4. Shade: call \ref Integrator::shade() for every hit, which appends
+ *    to the shadow ray and extension ray queues
+ * 5. Shadow: trace the shadow rays and accumulate unoccluded contributions
+ *
+ * Stages 2 to 5 repeat with the extension rays until all paths have
+ * terminated, after which the samples are splatted into an image block.
+ * Rays and path states are kept in structure-of-arrays form, so every
+ * stage is a tight loop over contiguous memory that accesses the same
+ * code (BVH traversal, or a single BSDF) over and over again. The
+ * intersection stages interleave the traversals of several rays (see
+ * \ref Accel::rayIntersect()) to hide memory latency.
+ *
+ * Each render thread owns one instance, and the threads work on
+ * different image blocks (see \ref TileScheduler).
+ *
+ * Since the paths of a batch share one sampler, only the camera samples
+ * follow the per-pixel sequence of a stratified sampler (e.g. Sobol),
+ * while the shading stage merely consumes further decorrelated values.
+ */
+class WavefrontRenderer {
+public:
+    /**
+     * \brief Create a renderer for the given scene
+     *
+     * \param interleave
+     *    Number of ray traversals that are interleaved during the
+     *    intersection stages (1: trace one ray after the other)
+     *
+     * \param filterSampler
+     *    If given, the positions of the samples are importance sampled
+     *    from the reconstruction filter, and every sample is added to a
+     *    single pixel. Otherwise, samples are splatted.
+     */
+    WavefrontRenderer(const Scene *scene, uint32_t interleave = 8,
+                      const FilterSampler *filterSampler = nullptr);
+
+    /// Queue \c sampleCount samples of the given pixel
+    void generate(Sampler *sampler, const Point2i &pixel, uint32_t sampleCount);
+
+    /// Return the number of queued paths
+    size_t getPathCount() const { return m_pixelX.size(); }
+
+    /**
+     * \brief Trace all queued paths and splat their contributions into
+     * \c block (and \c variance, if provided)
+     */
+    void render(Sampler *sampler, ImageBlock &block, VarianceBuffer *variance = nullptr);
+
+    /// Return a human-readable string summary
+    std::string toString() const;
+protected:
+    /// Rays in structure-of-arrays layout
+    struct RayQueue {
+        std::vector<float> ox, oy, oz, dx, dy, dz, mint, maxt;
+        std::vector<uint32_t> path;
+
+        size_t size() const { return path.size(); }
+        void clear();
+        void push(const Ray3f &ray, uint32_t path);
+        Ray3f get(size_t i) const;
+    };
+
+    void intersect();
+    void sort();
+    void shade(Sampler *sampler);
+    void traceShadowRays();
+
+private:
+    const Scene *m_scene;
+    const Integrator *m_integrator;
+    const FilterSampler *m_filterSampler;
+    uint32_t m_interleave;
+    std::unordered_map<const BSDF *, uint32_t> m_bsdfIndex;
+
+    /* Path state */
+    std::vector<int> m_pixelX, m_pixelY;
+    std::vector<float> m_sampleX, m_sampleY, m_weight;
+    std::vector<float> m_throughputR, m_throughputG, m_throughputB;
+    std::vector<float> m_radianceR, m_radianceG, m_radianceB;
+
+    /* Queues */
+    RayQueue m_rays, m_extensionRays, m_shadowRays;
+    std::vector<float> m_shadowR, m_shadowG, m_shadowB;
+    std::vector<Ray3f> m_rayBuffer;
+    std::vector<Intersection> m_hits;
+    std::unique_ptr<bool[]> m_hitFlags;
+    size_t m_hitCapacity = 0;
+    std::vector<uint32_t> m_hitRay;
+    std::vector<uint32_t> m_hitKey;
+    std::vector<uint32_t> m_order;
+    std::vector<uint32_t> m_keyOffset;
+};
+
+NORI_NAMESPACE_END
@@ -22,6 +22,13 @@
 #include <Eigen/Geometry>
 #include <atomic>
 
+#if defined(_MSC_VER)
+#  include <xmmintrin.h>
+#  define NORI_PREFETCH(ptr) _mm_prefetch((const char *) (ptr), _MM_HINT_T0)
+#else
+#  define NORI_PREFETCH(ptr) __builtin_prefetch(ptr)
+#endif
+
 /*
  * =======================================================================
  *   WARNING    WARNING    WARNING    WARNING    WARNING    WARNING
@@ -454,53 +461,157 @@ bool Accel::rayIntersect(const Ray3f &_ray, Intersection &its, bool shadowRay) c
         }
     }
 
-    if (foundIntersection) {
-        /* Find the barycentric coordinates */
-        Vector3f bary;
-        bary << 1-its.uv.sum(), its.uv;
-
-        /* References to all relevant mesh buffers */
-        const Mesh *mesh   = its.mesh;
-        const MatrixXf &V  = mesh->getVertexPositions();
-        const MatrixXf &N  = mesh->getVertexNormals();
-        const MatrixXf &UV = mesh->getVertexTexCoords();
-        const MatrixXu &F  = mesh->getIndices();
-
-        /* Vertex indices of the triangle */
-        uint32_t idx0 = F(0, f), idx1 = F(1, f), idx2 = F(2, f);
-
-        Point3f p0 = V.col(idx0), p1 = V.col(idx1), p2 = V.col(idx2);
-
-        /* Compute the intersection positon accurately
-           using barycentric coordinates */
-        its.p = bary.x() * p0 + bary.y() * p1 + bary.z() * p2;
-
-        /* Compute proper texture coordinates if provided by the mesh */
-        if (UV.size() > 0)
-            its.uv = bary.x() * UV.col(idx0),
-                bary.y() * UV.col(idx1),
-                bary.z() * UV.col(idx2);
-
-        /* Compute the geometry frame */
-        its.geoFrame = Frame((p1-p0).cross(p2-p0).normalized());
-
-        if (N.size() > 0) {
-            /* Compute the shading frame. Note that for simplicity,
-               the current implementation doesn't attempt to provide
-               tangents that are continuous across the surface. That
-               means that this code will need to be modified to be able
-               use anisotropic BRDFs, which need tangent continuity */
-
-            its.shFrame = Frame(
-                (bary.x() * N.col(idx0) +
-                 bary.y() * N.col(idx1) +
-                 bary.z() * N.col(idx2)).normalized());
-        } else {
-            its.shFrame = its.geoFrame;
+    if (foundIntersection)
+        finalize(its, f);
+
+    return foundIntersection;
+}
+
+void Accel::finalize(Intersection &its, uint32_t f) const {
+    /* Find the barycentric coordinates */
+    Vector3f bary;
+    bary << 1-its.uv.sum(), its.uv;
+
+    /* References to all relevant mesh buffers */
+    const Mesh *mesh   = its.mesh;
+    const MatrixXf &V  = mesh->getVertexPositions();
+    const MatrixXf &N  = mesh->getVertexNormals();
+    const MatrixXf &UV = mesh->getVertexTexCoords();
+    const MatrixXu &F  = mesh->getIndices();
+
+    /* Vertex indices of the triangle */
+    uint32_t idx0 = F(0, f), idx1 = F(1, f), idx2 = F(2, f);
+
+    Point3f p0 = V.col(idx0), p1 = V.col(idx1), p2 = V.col(idx2);
+
+    /* Compute the intersection positon accurately
+       using barycentric coordinates */
+    its.p = bary.x() * p0 + bary.y() * p1 + bary.z() * p2;
+
+    /* Compute proper texture coordinates if provided by the mesh */
+    if (UV.size() > 0)
+        its.uv = bary.x() * UV.col(idx0),
+            bary.y() * UV.col(idx1),
+            bary.z() * UV.col(idx2);
+
+    /* Compute the geometry frame */
+    its.geoFrame = Frame((p1-p0).cross(p2-p0).normalized());
+
+    if (N.size() > 0) {
+        /* Compute the shading frame. Note that for simplicity,
+           the current implementation doesn't attempt to provide
+           tangents that are continuous across the surface. That
+           means that this code will need to be modified to be able
+           use anisotropic BRDFs, which need tangent continuity */
+
+        its.shFrame = Frame(
+            (bary.x() * N.col(idx0) +
+             bary.y() * N.col(idx1) +
+             bary.z() * N.col(idx2)).normalized());
+    } else {
+        its.shFrame = its.geoFrame;
+    }
+}
+
+bool Accel::begin(Traversal &t, const Ray3f &ray) const {
+    t.its.t = std::numeric_limits<float>::infinity();
+
+    /* Use an adaptive ray epsilon */
+    t.ray = ray;
+    if (t.ray.mint == Epsilon)
+        t.ray.mint = std::max(t.ray.mint, t.ray.mint * t.ray.o.array().abs().maxCoeff());
+
+    t.node = t.stackIdx = t.f = 0;
+    t.found = false;
+    return !m_nodes.empty() && t.ray.maxt >= t.ray.mint;
+}
+
+bool Accel::step(Traversal &t, bool shadowRay) const {
+    /* Same as the loop in rayIntersect(), but only for a single node */
+    const BVHNode &node = m_nodes[t.node];
+    bool visit = node.bbox.rayIntersect(t.ray);
+
+    if (visit && node.isInner()) {
+        t.stack[t.stackIdx++] = node.inner.rightChild;
+        t.node++;
+        assert(t.stackIdx<64);
+    } else {
+        if (visit) {
+            for (uint32_t i = node.start(), end = node.end(); i < end; ++i) {
+                uint32_t idx = m_indices[i];
+                const Mesh *mesh = m_meshes[findMesh(idx)];
+
+                float u, v, tHit;
+                if (mesh->rayIntersect(idx, t.ray, u, v, tHit)) {
+                    t.found = true;
+                    if (shadowRay)
+                        return false;
+                    t.ray.maxt = t.its.t = tHit;
+                    t.its.uv = Point2f(u, v);
+                    t.its.mesh = mesh;
+                    t.f = idx;
+                }
+            }
         }
+        if (t.stackIdx == 0)
+            return false;
+        t.node = t.stack[--t.stackIdx];
     }
 
-    return foundIntersection;
+    /* Request the next node, which will be needed when this traversal resumes */
+    NORI_PREFETCH(&m_nodes[t.node]);
+    return true;
+}
+
+void Accel::rayIntersect(uint32_t count, const Ray3f *rays, Intersection *its,
+                         bool *hit, bool shadowRay, uint32_t interleave) const {
+    Traversal traversals[NORI_MAX_INTERLEAVE];
+    interleave = std::max(1u, std::min(interleave, (uint32_t) NORI_MAX_INTERLEAVE));
+
+    /* Store the result of a traversal */
+    auto finish = [&](Traversal &t) {
+        hit[t.index] = t.found;
+        if (t.found && !shadowRay) {
+            finalize(t.its, t.f);
+            its[t.index] = t.its;
+        }
+    };
+
+    /* Start the traversal of the next ray that might hit something */
+    uint32_t next = 0;
+    auto start = [&](Traversal &t) -> bool {
+        while (next < count) {
+            t.index = next++;
+            if (begin(t, rays[t.index])) {
+                NORI_PREFETCH(&m_nodes[0]);
+                return true;
+            }
+            hit[t.index] = false;
+        }
+        return false;
+    };
+
+    uint32_t active = 0;
+    while (active < interleave && start(traversals[active]))
+        ++active;
+
+    /* Round-robin over the active traversals, one node at a time */
+    while (active > 0) {
+        for (uint32_t i = 0; i < active; ) {
+            Traversal &t = traversals[i];
+            if (step(t, shadowRay)) {
+                ++i;
+                continue;
+            }
+            finish(t);
+            if (!start(t)) {
+                /* No rays left: compact the list of active traversals */
+                std::swap(t, traversals[--active]);
+            } else {
+                ++i;
+            }
+        }
+    }
 }
 
 NORI_NAMESPACE_END
@@ -5,11 +5,13 @@
 NORI_NAMESPACE_BEGIN
 
 /**
- * \brief Superclass of all emitters
+ * \brief Area light that emits constant radiance from the front
+ * side of the mesh it is attached to
  */
 class AreaLight : public Emitter {
    private:
     Color3f m_radiance;
+    const Mesh *m_mesh = nullptr;
 
    public:
     AreaLight(const PropertyList &props) {
@@ -17,10 +19,51 @@ class AreaLight : public Emitter {
     }
     Color3f getRadiance() { return m_radiance; }
 
-    std::string toString() const { return "Area[]"; }
+    void setParent(NoriObject *parent) {
+        if (parent->getClassType() != EMesh &&
+            parent->getClassType() != EEmitter)
+            throw NoriException("AreaLight: must be attached to a mesh!");
+        m_mesh = static_cast<const Mesh *>(parent);
+    }
+
+    Color3f sample(EmitterQueryRecord &lRec, const Point2f &sample) const {
+        float pdfArea = m_mesh->samplePosition(sample, lRec.p, lRec.n);
+
+        lRec.wi = lRec.p - lRec.ref;
+        float dist2 = lRec.wi.squaredNorm();
+        lRec.dist = std::sqrt(dist2);
+        lRec.wi /= lRec.dist;
+
+        /* Convert the area density into a solid angle density */
+        float cosTheta = lRec.n.dot(-lRec.wi);
+        if (cosTheta <= 0) {
+            lRec.pdf = 0.f;
+            return Color3f(0.f);
+        }
+        lRec.pdf = pdfArea * dist2 / cosTheta;
+        lRec.shadowRay = Ray3f(lRec.ref, lRec.wi, Epsilon,
+                               lRec.dist * (1 - Epsilon));
+
+        return m_radiance / lRec.pdf;
+    }
+
+    Color3f eval(const EmitterQueryRecord &lRec) const {
+        return lRec.n.dot(-lRec.wi) > 0 ? m_radiance : Color3f(0.f);
+    }
+
+    float pdf(const EmitterQueryRecord &lRec) const {
+        float cosTheta = lRec.n.dot(-lRec.wi);
+        if (cosTheta <= 0)
+            return 0.f;
+        return m_mesh->pdfPosition() * lRec.dist * lRec.dist / cosTheta;
+    }
+
+    std::string toString() const {
+        return tfm::format("Area[radiance=%s]", m_radiance.toString());
+    }
 
     EClassType getClassType() const { return EEmitter; }
 };
 
 NORI_REGISTER_CLASS(AreaLight, "area");
-NORI_NAMESPACE_END
\ No newline at end of file
+NORI_NAMESPACE_END
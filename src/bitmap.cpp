@@ -11,12 +11,79 @@
 #include <ImfStringAttribute.h>
 #include <ImfVersion.h>
 #include <ImfIO.h>
+#include <ImfThreading.h>
+#include <half.h>
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+#include <tbb/task_scheduler_init.h>
+#include <algorithm>
+#include <mutex>
 
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include <stb_image_write.h>
 
 NORI_NAMESPACE_BEGIN
 
+static_assert((int) EXROptions::EDWAB == (int) Imf::DWAB_COMPRESSION,
+              "EXROptions::ECompression must match Imf::Compression");
+
+EXROptions::ECompression EXROptions::parseCompression(const std::string &name) {
+    static const char *names[] = {
+        "none", "rle", "zips", "zip", "piz", "pxr24", "b44", "b44a", "dwaa", "dwab"
+    };
+    for (int i = 0; i <= EDWAB; ++i)
+        if (toLower(name) == names[i])
+            return (ECompression) i;
+    throw NoriException("Unknown OpenEXR compression \"%s\" (expected none, rle, zips, "
+                        "zip, piz, pxr24, b44, b44a, dwaa, or dwab)", name);
+}
+
+/**
+ * Conversion of linear values to 8-bit sRGB. Entry \c i holds the smallest
+ * linear value that maps to code \c i, so that the code of a value is the
+ * number of entries that it reaches (found with a binary search). This
+ * gives the same result as converting with \ref Color3f::toSRGB() and
+ * truncating, without evaluating \c std::pow() for every pixel.
+ */
+struct SRGBTable {
+    float thresholds[256];
+
+    SRGBTable() {
+        thresholds[0] = -std::numeric_limits<float>::infinity();
+        for (int i = 1; i < 256; ++i) {
+            /* Invert the curve, and then correct the float rounding
+               so that the result agrees with toSRGB() exactly */
+            float value = Color3f(i / 255.f).toLinearRGB().r();
+            while (value > 0 && 255.f * Color3f(value).toSRGB().r() >= i)
+                value = std::nextafter(value, 0.f);
+            while (255.f * Color3f(value).toSRGB().r() < i)
+                value = std::nextafter(value, std::numeric_limits<float>::infinity());
+            thresholds[i] = value;
+        }
+    }
+
+    uint8_t operator()(float value) const {
+        int code = 0;
+        for (int step = 128; step > 0; step /= 2)
+            if (value >= thresholds[code + step])
+                code += step;
+        return (uint8_t) code;
+    }
+};
+
+/// Set the number of threads that OpenEXR compresses with (0: one per core)
+static void setEXRThreads(int threadCount) {
+    static std::mutex mutex;
+    static int current = -1;
+    if (threadCount <= 0)
+        threadCount = tbb::task_scheduler_init::default_num_threads();
+    std::lock_guard<std::mutex> lock(mutex);
+    if (threadCount != current) {
+        Imf::setGlobalThreadCount(threadCount);
+        current = threadCount;
+    }
+}
+
 Bitmap::Bitmap(const std::string &filename) {
     Imf::InputFile file(filename.c_str());
     const Imf::Header &header = file.header();
@@ -56,7 +123,9 @@ Bitmap::Bitmap(const std::string &filename) {
            pixelStride = 3 * compStride,
            rowStride = pixelStride * cols();
 
-    char *ptr = reinterpret_cast<char *>(data());
+    /* Slices are addressed relative to the origin of the display window */
+    char *ptr = reinterpret_cast<char *>(data())
+        - dw.min.x * pixelStride - dw.min.y * rowStride;
 
     Imf::FrameBuffer frameBuffer;
     frameBuffer.insert(ch_r, Imf::Slice(Imf::FLOAT, ptr, pixelStride, rowStride)); ptr += compStride;
@@ -66,29 +135,58 @@ Bitmap::Bitmap(const std::string &filename) {
     file.readPixels(dw.min.y, dw.max.y);
 }
 
-void Bitmap::saveEXR(const std::string &filename) {
+void Bitmap::saveEXR(const std::string &filename, const Point2i &offset, const Vector2i &_imageSize,
+                     const EXROptions &options) {
+    setEXRThreads(options.threadCount);
+
     cout << "Writing a " << cols() << "x" << rows()
          << " OpenEXR file to \"" << filename << "\"" << endl;
 
     std::string path = filename + ".exr";
 
-    Imf::Header header((int) cols(), (int) rows());
+    Vector2i imageSize = _imageSize;
+    if (imageSize == Vector2i(0, 0))
+        imageSize = Vector2i((int) cols(), (int) rows());
+
+    Imf::Header header(
+        Imath::Box2i(Imath::V2i(0, 0), Imath::V2i(imageSize.x() - 1, imageSize.y() - 1)),
+        Imath::Box2i(Imath::V2i(offset.x(), offset.y()),
+                     Imath::V2i(offset.x() + (int) cols() - 1, offset.y() + (int) rows() - 1)));
     header.insert("comments", Imf::StringAttribute("Generated by Nori"));
+    header.compression() = (Imf::Compression) options.compression;
 
+    Imf::PixelType type = options.half ? Imf::HALF : Imf::FLOAT;
     Imf::ChannelList &channels = header.channels();
-    channels.insert("R", Imf::Channel(Imf::FLOAT));
-    channels.insert("G", Imf::Channel(Imf::FLOAT));
-    channels.insert("B", Imf::Channel(Imf::FLOAT));
+    channels.insert("R", Imf::Channel(type));
+    channels.insert("G", Imf::Channel(type));
+    channels.insert("B", Imf::Channel(type));
+
+    /* Convert to half precision in parallel */
+    std::unique_ptr<half[]> halfData;
+    if (options.half) {
+        halfData.reset(new half[3 * size()]);
+        tbb::parallel_for(tbb::blocked_range<int>(0, (int) rows()),
+            [&](const tbb::blocked_range<int> &range) {
+                for (int y = range.begin(); y != range.end(); ++y) {
+                    const float *src = reinterpret_cast<const float *>(&coeff(y, 0));
+                    half *dst = halfData.get() + 3 * y * cols();
+                    for (int i = 0; i < 3 * cols(); ++i)
+                        dst[i] = half(src[i]);
+                }
+            });
+    }
 
     Imf::FrameBuffer frameBuffer;
-    size_t compStride = sizeof(float),
+    size_t compStride = options.half ? sizeof(half) : sizeof(float),
            pixelStride = 3 * compStride,
            rowStride = pixelStride * cols();
 
-    char *ptr = reinterpret_cast<char *>(data());
-    frameBuffer.insert("R", Imf::Slice(Imf::FLOAT, ptr, pixelStride, rowStride)); ptr += compStride;
-    frameBuffer.insert("G", Imf::Slice(Imf::FLOAT, ptr, pixelStride, rowStride)); ptr += compStride;
-    frameBuffer.insert("B", Imf::Slice(Imf::FLOAT, ptr, pixelStride, rowStride));
+    char *ptr = (options.half ? reinterpret_cast<char *>(halfData.get())
+                              : reinterpret_cast<char *>(data()))
+        - offset.x() * pixelStride - offset.y() * rowStride;
+    frameBuffer.insert("R", Imf::Slice(type, ptr, pixelStride, rowStride)); ptr += compStride;
+    frameBuffer.insert("G", Imf::Slice(type, ptr, pixelStride, rowStride)); ptr += compStride;
+    frameBuffer.insert("B", Imf::Slice(type, ptr, pixelStride, rowStride));
 
     Imf::OutputFile file(path.c_str(), header);
     file.setFrameBuffer(frameBuffer);
@@ -101,17 +199,22 @@ void Bitmap::savePNG(const std::string &filename) {
 
     std::string path = filename + ".png";
 
+    static const SRGBTable toSRGB8;
+
     uint8_t *rgb8 = new uint8_t[3 * cols() * rows()];
-    uint8_t *dst = rgb8;
-    for (int i = 0; i < rows(); ++i) {
-        for (int j = 0; j < cols(); ++j) {
-            Color3f tonemapped = coeffRef(i, j).toSRGB();
-            dst[0] = (uint8_t) clamp(255.f * tonemapped[0], 0.f, 255.f);
-            dst[1] = (uint8_t) clamp(255.f * tonemapped[1], 0.f, 255.f);
-            dst[2] = (uint8_t) clamp(255.f * tonemapped[2], 0.f, 255.f);
-            dst += 3;
-        }
-    }
+    tbb::parallel_for(tbb::blocked_range<int>(0, (int) rows()),
+        [&](const tbb::blocked_range<int> &range) {
+            for (int i = range.begin(); i != range.end(); ++i) {
+                uint8_t *dst = rgb8 + 3 * i * cols();
+                for (int j = 0; j < cols(); ++j) {
+                    const Color3f &value = coeff(i, j);
+                    dst[0] = toSRGB8(value[0]);
+                    dst[1] = toSRGB8(value[1]);
+                    dst[2] = toSRGB8(value[2]);
+                    dst += 3;
+                }
+            }
+        });
 
     int ret = stbi_write_png(path.c_str(), (int) cols(), (int) rows(), 3, rgb8, 3 * (int) cols());
     if (ret == 0) {
@@ -9,9 +9,46 @@
 #include <nori/rfilter.h>
 #include <nori/bbox.h>
 #include <tbb/tbb.h>
+#include <ImfInputFile.h>
+#include <ImfOutputFile.h>
+#include <ImfChannelList.h>
+#include <ImfStringAttribute.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  include <emmintrin.h>
+#  define NORI_SPLAT_SSE 1
+#endif
 
 NORI_NAMESPACE_BEGIN
 
+/**
+ * Replace the distances in \c values (a multiple of 4) by the
+ * corresponding entries of the tabulated filter. Distances beyond the
+ * radius map to the final (zero) entry.
+ */
+static inline void lookupFilter(const float *filter, float lookupFactor,
+                                float *values, int count) {
+#if defined(NORI_SPLAT_SSE)
+    const __m128 signMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    const __m128 factor = _mm_set1_ps(lookupFactor);
+    const __m128 maxIndex = _mm_set1_ps((float) NORI_FILTER_RESOLUTION);
+    alignas(16) int32_t index[4];
+    for (int i=0; i<count; i += 4) {
+        __m128 dist = _mm_and_ps(_mm_loadu_ps(values + i), signMask);
+        __m128 pos = _mm_min_ps(_mm_mul_ps(dist, factor), maxIndex);
+        _mm_store_si128((__m128i *) index, _mm_cvttps_epi32(pos));
+        values[i]   = filter[index[0]];
+        values[i+1] = filter[index[1]];
+        values[i+2] = filter[index[2]];
+        values[i+3] = filter[index[3]];
+    }
+#else
+    for (int i=0; i<count; ++i)
+        values[i] = filter[(int) std::min(std::abs(values[i]) * lookupFactor,
+                                          (float) NORI_FILTER_RESOLUTION)];
+#endif
+}
+
 ImageBlock::ImageBlock(const Vector2i &size, const ReconstructionFilter *filter) 
         : m_offset(0, 0), m_size(size) {
     if (filter) {
@@ -25,7 +62,11 @@ ImageBlock::ImageBlock(const Vector2i &size, const ReconstructionFilter *filter)
         }
         m_filter[NORI_FILTER_RESOLUTION] = 0.0f;
         m_lookupFactor = NORI_FILTER_RESOLUTION / m_filterRadius;
-        int weightSize = (int) std::ceil(2*m_filterRadius) + 1;
+
+        /* Weights of a group of samples over their combined footprint,
+           which is at most one pixel wider than that of a single sample */
+        m_footprintSize = (int) std::ceil(2*m_filterRadius) + 2;
+        int weightSize = m_footprintSize * NORI_SPLAT_BATCH;
         m_weightsX = new float[weightSize];
         m_weightsY = new float[weightSize];
         memset(m_weightsX, 0, sizeof(float) * weightSize);
@@ -34,6 +75,11 @@ ImageBlock::ImageBlock(const Vector2i &size, const ReconstructionFilter *filter)
 
     /* Allocate space for pixels and border regions */
     resize(size.y() + 2*m_borderSize, size.x() + 2*m_borderSize);
+
+    m_stripeCount = ((int) rows() + NORI_STRIPE_HEIGHT - 1) / NORI_STRIPE_HEIGHT;
+    m_stripes.reset(new tbb::spin_mutex[m_stripeCount]);
+    m_changed.reset(new ChangedSpan[m_stripeCount]);
+    markChanged();
 }
 
 ImageBlock::~ImageBlock() {
@@ -44,9 +90,12 @@ ImageBlock::~ImageBlock() {
 
 Bitmap *ImageBlock::toBitmap() const {
     Bitmap *result = new Bitmap(m_size);
-    for (int y=0; y<m_size.y(); ++y)
-        for (int x=0; x<m_size.x(); ++x)
-            result->coeffRef(y, x) = coeff(y + m_borderSize, x + m_borderSize).divideByFilterWeight();
+    tbb::parallel_for(tbb::blocked_range<int>(0, m_size.y()),
+        [&](const tbb::blocked_range<int> &range) {
+            for (int y=range.begin(); y!=range.end(); ++y)
+                for (int x=0; x<m_size.x(); ++x)
+                    result->coeffRef(y, x) = coeff(y + m_borderSize, x + m_borderSize).divideByFilterWeight();
+        });
     return result;
 }
 
@@ -59,46 +108,258 @@ void ImageBlock::fromBitmap(const Bitmap &bitmap) {
             coeffRef(y, x) << bitmap.coeff(y, x), 1;
 }
 
-void ImageBlock::put(const Point2f &_pos, const Color3f &value) {
-    if (!value.isValid()) {
-        /* If this happens, go fix your code instead of removing this warning ;) */
-        cerr << "Integrator: computed an invalid radiance value: " << value.toString() << endl;
-        return;
+void ImageBlock::saveWeightedEXR(const std::string &filename, const Vector2i &imageSize) const {
+    /* Pixels of the block and its border that lie inside the image */
+    Point2i min = (m_offset - Vector2i::Constant(m_borderSize)).cwiseMax(Point2i(0, 0));
+    Point2i max = (m_offset + m_size + Vector2i::Constant(m_borderSize)).cwiseMin(imageSize) - Vector2i(1, 1);
+    Vector2i size = max - min + Vector2i(1, 1);
+
+    cout << "Writing a " << size.x() << "x" << size.y()
+         << " weighted OpenEXR file to \"" << filename << "\"" << endl;
+
+    std::string path = filename + ".exr";
+
+    Imf::Header header(
+        Imath::Box2i(Imath::V2i(0, 0), Imath::V2i(imageSize.x() - 1, imageSize.y() - 1)),
+        Imath::Box2i(Imath::V2i(min.x(), min.y()), Imath::V2i(max.x(), max.y())));
+    header.insert("comments", Imf::StringAttribute("Generated by Nori (unnormalized, weights in W)"));
+
+    Imf::ChannelList &channels = header.channels();
+    channels.insert("R", Imf::Channel(Imf::FLOAT));
+    channels.insert("G", Imf::Channel(Imf::FLOAT));
+    channels.insert("B", Imf::Channel(Imf::FLOAT));
+    channels.insert("W", Imf::Channel(Imf::FLOAT));
+
+    /* Slices are addressed relative to the origin of the image */
+    Imf::FrameBuffer frameBuffer;
+    size_t compStride = sizeof(float),
+           pixelStride = sizeof(Color4f),
+           rowStride = pixelStride * cols();
+
+    Point2i origin = m_offset - Vector2i::Constant(m_borderSize);
+    char *ptr = const_cast<char *>(reinterpret_cast<const char *>(data()))
+        - origin.x() * pixelStride - origin.y() * rowStride;
+    frameBuffer.insert("R", Imf::Slice(Imf::FLOAT, ptr, pixelStride, rowStride)); ptr += compStride;
+    frameBuffer.insert("G", Imf::Slice(Imf::FLOAT, ptr, pixelStride, rowStride)); ptr += compStride;
+    frameBuffer.insert("B", Imf::Slice(Imf::FLOAT, ptr, pixelStride, rowStride)); ptr += compStride;
+    frameBuffer.insert("W", Imf::Slice(Imf::FLOAT, ptr, pixelStride, rowStride));
+
+    Imf::OutputFile file(path.c_str(), header);
+    file.setFrameBuffer(frameBuffer);
+    file.writePixels(size.y());
+}
+
+void ImageBlock::addWeightedEXR(const std::string &filename) {
+    Imf::InputFile file(filename.c_str());
+    const Imf::ChannelList &channels = file.header().channels();
+    Imath::Box2i dw = file.header().dataWindow();
+    Vector2i size(dw.max.x - dw.min.x + 1, dw.max.y - dw.min.y + 1);
+
+    /* Position of the data window within the block */
+    Point2i pos = Point2i(dw.min.x, dw.min.y) - m_offset + Vector2i::Constant(m_borderSize);
+    if ((pos.array() < 0).any() || pos.x() + size.x() > cols() || pos.y() + size.y() > rows())
+        throw NoriException("\"%s\" covers [%i, %i]..[%i, %i], which is outside of %s!", filename,
+                            dw.min.x, dw.min.y, dw.max.x, dw.max.y, toString());
+    if (!channels.findChannel("R") || !channels.findChannel("G") ||
+        !channels.findChannel("B") || !channels.findChannel("W"))
+        throw NoriException("\"%s\" is not a weighted OpenEXR file (R, G, B, W)!", filename);
+
+    Base pixels(size.y(), size.x());
+    size_t compStride = sizeof(float),
+           pixelStride = sizeof(Color4f),
+           rowStride = pixelStride * size.x();
+
+    /* Slices are addressed relative to the origin of the data window */
+    char *ptr = reinterpret_cast<char *>(pixels.data())
+        - dw.min.x * pixelStride - dw.min.y * rowStride;
+
+    Imf::FrameBuffer frameBuffer;
+    frameBuffer.insert("R", Imf::Slice(Imf::FLOAT, ptr, pixelStride, rowStride)); ptr += compStride;
+    frameBuffer.insert("G", Imf::Slice(Imf::FLOAT, ptr, pixelStride, rowStride)); ptr += compStride;
+    frameBuffer.insert("B", Imf::Slice(Imf::FLOAT, ptr, pixelStride, rowStride)); ptr += compStride;
+    frameBuffer.insert("W", Imf::Slice(Imf::FLOAT, ptr, pixelStride, rowStride));
+    file.setFrameBuffer(frameBuffer);
+    file.readPixels(dw.min.y, dw.max.y);
+
+    block(pos.y(), pos.x(), size.y(), size.x()) += pixels;
+    markChanged();
+}
+
+void ImageBlock::put(size_t count, const Point2f *positions, const Color3f *values) {
+    Point2f pos[NORI_SPLAT_BATCH];
+    Color4f value[NORI_SPLAT_BATCH];
+    BoundingBox2i bbox;
+    int n = 0;
+
+    for (size_t i=0; i<count; ++i) {
+        if (!values[i].isValid()) {
+            /* If this happens, go fix your code instead of removing this warning ;) */
+            cerr << "Integrator: computed an invalid radiance value: " << values[i].toString() << endl;
+            continue;
+        }
+
+        /* Convert to pixel coordinates within the image block */
+        Point2f p(
+            positions[i].x() - 0.5f - (m_offset.x() - m_borderSize),
+            positions[i].y() - 0.5f - (m_offset.y() - m_borderSize)
+        );
+
+        /* Compute the rectangle of pixels that will need to be updated */
+        BoundingBox2i footprint(
+            Point2i((int)  std::ceil(p.x() - m_filterRadius), (int)  std::ceil(p.y() - m_filterRadius)),
+            Point2i((int) std::floor(p.x() + m_filterRadius), (int) std::floor(p.y() + m_filterRadius))
+        );
+
+        /* Add the sample to the current group if the combined footprint
+           still fits, otherwise splat the group and start a new one */
+        if (n > 0) {
+            BoundingBox2i combined(bbox);
+            combined.expandBy(footprint);
+            Vector2i extents = combined.getExtents();
+            if (n == NORI_SPLAT_BATCH || extents.x() >= m_footprintSize ||
+                extents.y() >= m_footprintSize) {
+                splat(n, pos, value, bbox);
+                n = 0;
+            } else {
+                bbox = combined;
+            }
+        }
+        if (n == 0)
+            bbox = footprint;
+
+        pos[n] = p;
+        value[n++] = Color4f(values[i]);
     }
 
-    /* Convert to pixel coordinates within the image block */
-    Point2f pos(
-        _pos.x() - 0.5f - (m_offset.x() - m_borderSize),
-        _pos.y() - 0.5f - (m_offset.y() - m_borderSize)
-    );
-
-    /* Compute the rectangle of pixels that will need to be updated */
-    BoundingBox2i bbox(
-        Point2i((int)  std::ceil(pos.x() - m_filterRadius), (int)  std::ceil(pos.y() - m_filterRadius)),
-        Point2i((int) std::floor(pos.x() + m_filterRadius), (int) std::floor(pos.y() + m_filterRadius))
-    );
+    if (n > 0)
+        splat(n, pos, value, bbox);
+}
+
+void ImageBlock::splat(int count, const Point2f *pos, const Color4f *value,
+                       const BoundingBox2i &footprint) {
+    BoundingBox2i bbox(footprint);
     bbox.clip(BoundingBox2i(Point2i(0, 0), Point2i((int) cols() - 1, (int) rows() - 1)));
+    int width = bbox.max.x() - bbox.min.x() + 1, height = bbox.max.y() - bbox.min.y() + 1;
+    if (width <= 0 || height <= 0)
+        return;
 
-    /* Lookup values from the pre-rasterized filter */
+    /* Lookup values from the pre-rasterized filter. The weights of all
+       samples for a given column (or row) are stored next to each other,
+       padded to a multiple of 4 with samples that lie beyond the radius.
+       A single sample looks up its entire footprint at once instead. */
+    int stride = count == 1 ? 1 : (count + 3) & ~3;
     for (int x=bbox.min.x(), idx = 0; x<=bbox.max.x(); ++x)
-        m_weightsX[idx++] = m_filter[(int) (std::abs(x-pos.x()) * m_lookupFactor)];
+        for (int i=0; i<stride; ++i)
+            m_weightsX[idx++] = i < count ? x - pos[i].x() : m_filterRadius;
     for (int y=bbox.min.y(), idx = 0; y<=bbox.max.y(); ++y)
-        m_weightsY[idx++] = m_filter[(int) (std::abs(y-pos.y()) * m_lookupFactor)];
+        for (int i=0; i<stride; ++i)
+            m_weightsY[idx++] = i < count ? y - pos[i].y() : m_filterRadius;
+    lookupFilter(m_filter, m_lookupFactor, m_weightsX, (width * stride + 3) & ~3);
+    lookupFilter(m_filter, m_lookupFactor, m_weightsY, (height * stride + 3) & ~3);
+
+    Color4f rowValue[NORI_SPLAT_BATCH];
+    for (int y=bbox.min.y(), yr=0; y<=bbox.max.y(); ++y, ++yr) {
+        const float *weightsY = m_weightsY + yr * stride;
+        for (int i=0; i<count; ++i)
+            rowValue[i] = value[i] * weightsY[i];
 
-    for (int y=bbox.min.y(), yr=0; y<=bbox.max.y(); ++y, ++yr) 
-        for (int x=bbox.min.x(), xr=0; x<=bbox.max.x(); ++x, ++xr) 
-            coeffRef(y, x) += Color4f(value) * m_weightsX[xr] * m_weightsY[yr];
+        for (int x=bbox.min.x(), xr=0; x<=bbox.max.x(); ++x, ++xr) {
+            const float *weightsX = m_weightsX + xr * stride;
+            Color4f sum = rowValue[0] * weightsX[0];
+            for (int i=1; i<count; ++i)
+                sum += rowValue[i] * weightsX[i];
+            coeffRef(y, x) += sum;
+        }
+    }
 }
-    
+
 void ImageBlock::put(ImageBlock &b) {
     Vector2i offset = b.getOffset() - m_offset +
         Vector2i::Constant(m_borderSize - b.getBorderSize());
     Vector2i size   = b.getSize()   + Vector2i(2*b.getBorderSize());
 
-    tbb::mutex::scoped_lock lock(m_mutex);
+    /* Merge one stripe of rows at a time */
+    for (int y = offset.y(); y < offset.y() + size.y(); ) {
+        int stripe = y / NORI_STRIPE_HEIGHT;
+        int end = std::min((stripe + 1) * NORI_STRIPE_HEIGHT, offset.y() + size.y());
+
+        tbb::spin_mutex::scoped_lock lock(m_stripes[stripe]);
+        block(y, offset.x(), end - y, size.x())
+            += b.block(y - offset.y(), 0, end - y, size.x());
+
+        ChangedSpan &span = m_changed[stripe];
+        if (span.begin < span.end) {
+            span.begin = std::min(span.begin, offset.x());
+            span.end = std::max(span.end, offset.x() + size.x());
+        } else {
+            span.begin = offset.x();
+            span.end = offset.x() + size.x();
+        }
+        y = end;
+    }
+}
+
+void ImageBlock::snapshot(Base &target) const {
+    target.resize(rows(), cols());
+    for (int stripe = 0; stripe < m_stripeCount; ++stripe) {
+        int y = stripe * NORI_STRIPE_HEIGHT;
+        int count = std::min(NORI_STRIPE_HEIGHT, (int) rows() - y);
+
+        tbb::spin_mutex::scoped_lock lock(m_stripes[stripe]);
+        target.middleRows(y, count) = middleRows(y, count);
+    }
+}
 
-    block(offset.y(), offset.x(), size.y(), size.x()) 
-        += b.topLeftCorner(size.y(), size.x());
+void ImageBlock::snapshotChanges(Base &target, std::vector<BoundingBox2i> &changed) const {
+    bool all = target.rows() != rows() || target.cols() != cols();
+    if (all)
+        target.resize(rows(), cols());
+    changed.clear();
+
+    for (int stripe = 0; stripe < m_stripeCount; ++stripe) {
+        int y = stripe * NORI_STRIPE_HEIGHT;
+        int count = std::min(NORI_STRIPE_HEIGHT, (int) rows() - y);
+
+        ChangedSpan span;
+        {
+            tbb::spin_mutex::scoped_lock lock(m_stripes[stripe]);
+            span = m_changed[stripe];
+            m_changed[stripe] = ChangedSpan();
+            if (all) {
+                span.begin = 0;
+                span.end = (int) cols();
+            }
+            if (span.begin >= span.end)
+                continue;
+            target.block(y, span.begin, count, span.end - span.begin)
+                = block(y, span.begin, count, span.end - span.begin);
+        }
+
+        BoundingBox2i region(Point2i(span.begin, y), Point2i(span.end - 1, y + count - 1));
+        if (!changed.empty() && changed.back().max.y() == y - 1)
+            changed.back().expandBy(region);
+        else
+            changed.push_back(region);
+    }
+}
+
+void ImageBlock::clearLocked() {
+    for (int stripe = 0; stripe < m_stripeCount; ++stripe) {
+        int y = stripe * NORI_STRIPE_HEIGHT;
+        int count = std::min(NORI_STRIPE_HEIGHT, (int) rows() - y);
+
+        tbb::spin_mutex::scoped_lock lock(m_stripes[stripe]);
+        middleRows(y, count).setConstant(Color4f());
+        m_changed[stripe].begin = 0;
+        m_changed[stripe].end = (int) cols();
+    }
+}
+
+void ImageBlock::markChanged() {
+    for (int stripe = 0; stripe < m_stripeCount; ++stripe) {
+        m_changed[stripe].begin = 0;
+        m_changed[stripe].end = (int) cols();
+    }
 }
 
 std::string ImageBlock::toString() const {
@@ -106,49 +367,73 @@ std::string ImageBlock::toString() const {
         m_offset.toString(), m_size.toString());
 }
 
-BlockGenerator::BlockGenerator(const Vector2i &size, int blockSize)
-        : m_size(size), m_blockSize(blockSize) {
+BlockGenerator::BlockGenerator(const Vector2i &size, int blockSize, const Point2i &offset)
+        : m_size(size), m_offset(offset), m_blockSize(blockSize), m_next(0) {
     m_numBlocks = Vector2i(
         (int) std::ceil(size.x() / (float) blockSize),
         (int) std::ceil(size.y() / (float) blockSize));
-    m_blocksLeft = m_numBlocks.x() * m_numBlocks.y();
-    m_direction = ERight;
-    m_block = Point2i(m_numBlocks / 2);
-    m_stepsLeft = 1;
-    m_numSteps = 1;
-}
 
-bool BlockGenerator::next(ImageBlock &block) {
-    tbb::mutex::scoped_lock lock(m_mutex);
+    /* Walk along a spiral starting at the center block */
+    int blockCount = m_numBlocks.x() * m_numBlocks.y();
+    int direction = ERight, numSteps = 1, stepsLeft = 1;
+    Point2i block(m_numBlocks / 2);
+    m_order.reserve(blockCount);
 
-    if (m_blocksLeft == 0)
-        return false;
+    while ((int) m_order.size() < blockCount) {
+        m_order.push_back(block);
+        if ((int) m_order.size() == blockCount)
+            break;
 
-    Point2i pos = m_block * m_blockSize;
-    block.setOffset(pos);
-    block.setSize((m_size - pos).cwiseMin(Vector2i::Constant(m_blockSize)));
+        do {
+            switch (direction) {
+                case ERight: ++block.x(); break;
+                case EDown:  ++block.y(); break;
+                case ELeft:  --block.x(); break;
+                case EUp:    --block.y(); break;
+            }
 
-    if (--m_blocksLeft == 0)
-        return true;
+            if (--stepsLeft == 0) {
+                direction = (direction + 1) % 4;
+                if (direction == ELeft || direction == ERight)
+                    ++numSteps;
+                stepsLeft = numSteps;
+            }
+        } while ((block.array() < 0).any() ||
+                 (block.array() >= m_numBlocks.array()).any());
+    }
+}
 
-    do {
-        switch (m_direction) {
-            case ERight: ++m_block.x(); break;
-            case EDown:  ++m_block.y(); break;
-            case ELeft:  --m_block.x(); break;
-            case EUp:    --m_block.y(); break;
-        }
+bool BlockGenerator::next(ImageBlock &block) {
+    Point2i offset;
+    Vector2i size;
+    if (!next(offset, size))
+        return false;
+    block.setOffset(offset);
+    block.setSize(size);
+    return true;
+}
 
-        if (--m_stepsLeft == 0) {
-            m_direction = (m_direction + 1) % 4;
-            if (m_direction == ELeft || m_direction == ERight) 
-                ++m_numSteps;
-            m_stepsLeft = m_numSteps;
-        }
-    } while ((m_block.array() < 0).any() ||
-             (m_block.array() >= m_numBlocks.array()).any());
+bool BlockGenerator::next(Point2i &offset, Vector2i &size) {
+    int index = m_next.fetch_add(1, std::memory_order_relaxed);
+    if (index >= (int) m_order.size())
+        return false;
 
+    offset = m_order[index] * m_blockSize;
+    size = (m_size - offset).cwiseMin(Vector2i::Constant(m_blockSize));
+    offset += m_offset;
     return true;
 }
 
+int BlockGenerator::autoBlockSize(const Vector2i &size, int threadCount) {
+    int blockSize = 64;
+    while (blockSize > 8) {
+        int blockCount = ((size.x() + blockSize - 1) / blockSize) *
+                         ((size.y() + blockSize - 1) / blockSize);
+        if (blockCount >= 16 * threadCount)
+            break;
+        blockSize /= 2;
+    }
+    return blockSize;
+}
+
 NORI_NAMESPACE_END
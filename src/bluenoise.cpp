@@ -0,0 +1,238 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#include <nori/sampler.h>
+#include <nori/qmc.h>
+#include <pcg32.h>
+#include <cmath>
+
+/* Side length of the (tileable) blue-noise mask, a power of two */
+#define NORI_BLUE_NOISE_SIZE 64
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Blue-noise dither mask created with the void-and-cluster method
+ * (Ulichney, "The void-and-cluster method for dither array generation", 1993)
+ *
+ * Every pixel of the mask holds a distinct rank, and the pixels whose rank
+ * is below any threshold form a blue-noise pattern: they are spread evenly,
+ * without clumps, so the mask itself has no low-frequency content.
+ */
+class BlueNoiseMask {
+public:
+    BlueNoiseMask() {
+        const int N = NORI_BLUE_NOISE_SIZE, size = N * N;
+
+        /* Gaussian energy kernel on the torus */
+        const float sigma = 1.5f;
+        m_kernel.resize(size);
+        for (int y=0; y<N; ++y) {
+            for (int x=0; x<N; ++x) {
+                int dx = std::min(x, N - x), dy = std::min(y, N - y);
+                m_kernel[y * N + x] = std::exp(-(dx * dx + dy * dy) / (2 * sigma * sigma));
+            }
+        }
+
+        /* Random initial pattern with ~10% of the pixels set */
+        std::vector<bool> initial(size, false);
+        pcg32 random;
+        int ones = 0;
+        while (ones < size / 10) {
+            int i = (int) random.nextUInt((uint32_t) size);
+            if (!initial[i]) {
+                initial[i] = true;
+                ++ones;
+            }
+        }
+
+        /* Turn it into a blue-noise pattern: move the pixel of the tightest
+           cluster into the largest void, until that no longer changes anything */
+        m_energy.assign(size, 0.f);
+        for (int i=0; i<size; ++i)
+            if (initial[i])
+                splat(i, 1.f);
+        while (true) {
+            int cluster = find(initial, true);
+            initial[cluster] = false;
+            splat(cluster, -1.f);
+            int largestVoid = find(initial, false);
+            initial[largestVoid] = true;
+            splat(largestVoid, 1.f);
+            if (largestVoid == cluster)
+                break;
+        }
+
+        std::vector<uint32_t> rank(size);
+
+        /* Phase 1: rank the initial pattern by removing its tightest clusters */
+        std::vector<bool> pattern = initial;
+        std::vector<float> initialEnergy = m_energy;
+        for (int r=ones-1; r>=0; --r) {
+            int cluster = find(pattern, true);
+            pattern[cluster] = false;
+            splat(cluster, -1.f);
+            rank[cluster] = (uint32_t) r;
+        }
+
+        /* Phases 2 and 3: fill the largest voids (for the second half, this is
+           the same as removing the tightest clusters of the unset pixels) */
+        pattern = initial;
+        m_energy = initialEnergy;
+        for (int r=ones; r<size; ++r) {
+            int largestVoid = find(pattern, false);
+            pattern[largestVoid] = true;
+            splat(largestVoid, 1.f);
+            rank[largestVoid] = (uint32_t) r;
+        }
+
+        /* Store the ranks as evenly spaced 32-bit fixed-point values */
+        m_values.resize(size);
+        uint32_t step = (uint32_t) ((1ull << 32) / size);
+        for (int i=0; i<size; ++i)
+            m_values[i] = rank[i] * step + step / 2;
+
+        m_kernel.clear();
+        m_energy.clear();
+    }
+
+    /// Return the value (in 32-bit fixed point) at the given position, modulo the mask size
+    uint32_t operator()(uint32_t x, uint32_t y) const {
+        return m_values[(y % NORI_BLUE_NOISE_SIZE) * NORI_BLUE_NOISE_SIZE + x % NORI_BLUE_NOISE_SIZE];
+    }
+
+    /// Return the mask, which is created when it is first needed
+    static const BlueNoiseMask &get() {
+        static const BlueNoiseMask mask;
+        return mask;
+    }
+
+protected:
+    /// Add the kernel centered at pixel \c i to the energy
+    void splat(int i, float sign) {
+        const int N = NORI_BLUE_NOISE_SIZE;
+        int cx = i % N, cy = i / N;
+        for (int y=0; y<N; ++y) {
+            const float *kernel = m_kernel.data() + ((y - cy + N) % N) * N;
+            float *energy = m_energy.data() + y * N;
+            for (int x=0; x<N; ++x)
+                energy[x] += sign * kernel[(x - cx + N) % N];
+        }
+    }
+
+    /// Find the tightest cluster (\c set = true) or the largest void (\c set = false)
+    int find(const std::vector<bool> &pattern, bool set) const {
+        int best = -1;
+        for (int i=0; i<(int) pattern.size(); ++i) {
+            if (pattern[i] != set)
+                continue;
+            if (best < 0 || (set ? m_energy[i] > m_energy[best] : m_energy[i] < m_energy[best]))
+                best = i;
+        }
+        return best;
+    }
+
+private:
+    std::vector<float> m_kernel, m_energy;
+    std::vector<uint32_t> m_values;
+};
+
+/**
+ * \brief Sampler that distributes the error as blue noise across pixels
+ *
+ * This follows the blue-noise dithered sampling of Georgiev and Fajardo
+ * ("Blue-noise Dithered Sampling", SIGGRAPH 2016 talk): all pixels use the
+ * same Owen-scrambled Sobol points (see the \c sobol sampler), which are
+ * offset in every pixel and dimension by the value of a blue-noise mask.
+ * Instead of adding the offset (a Cranley-Patterson rotation), its bits
+ * are XORed with those of the samples (a digital shift), which keeps the
+ * stratification of the Sobol points intact. Neighboring pixels therefore
+ * receive samples that are far apart, and their errors are negatively
+ * correlated: the remaining noise has little low-frequency content, which
+ * the eye (and any denoiser or downsampling) averages away. This matters
+ * most at 1-4 spp, e.g. in the interactive preview; at higher sample
+ * counts the points of each pixel remain stratified.
+ *
+ * Each dimension uses the mask with a different toroidal offset, so that
+ * the dimensions are decorrelated. The mask (64x64 pixels) is created once
+ * per process, which takes a fraction of a second.
+ */
+class BlueNoise : public Sampler {
+public:
+    BlueNoise(const PropertyList &propList) : m_mask(BlueNoiseMask::get()) {
+        m_sampleCount = (size_t) propList.getInteger("sampleCount", 1);
+        m_seed = (uint32_t) propList.getInteger("seed", 0);
+    }
+
+    virtual ~BlueNoise() { }
+
+    std::unique_ptr<Sampler> clone() const {
+        std::unique_ptr<BlueNoise> cloned(new BlueNoise(m_mask));
+        cloned->m_sampleCount = m_sampleCount;
+        cloned->m_sampleOffset = m_sampleOffset;
+        cloned->m_seed = m_seed;
+        cloned->m_pixel = m_pixel;
+        cloned->m_sampleIndex = m_sampleIndex;
+        cloned->m_dimension = m_dimension;
+        return std::move(cloned);
+    }
+
+    void prepare(const ImageBlock &) {
+        /* The samples only depend on the pixel (see generate()) */
+        m_sampleIndex = (uint32_t) m_sampleOffset;
+        m_dimension = 0;
+    }
+
+    void generate(const Point2i &pixel) {
+        /* Negative coordinates must wrap around consistently */
+        m_pixel = Point2i(pixel.x() & (NORI_BLUE_NOISE_SIZE - 1), pixel.y() & (NORI_BLUE_NOISE_SIZE - 1));
+        m_sampleIndex = (uint32_t) m_sampleOffset;
+        m_dimension = 0;
+    }
+
+    void advance() {
+        ++m_sampleIndex;
+        m_dimension = 0;
+    }
+
+    float next1D() {
+        uint32_t seed = qmc::hash(m_seed, m_dimension++);
+        uint32_t index = qmc::owenScramble(m_sampleIndex, seed);
+        return qmc::toFloat(qmc::owenScramble(qmc::sobol0(index), qmc::mix(seed)) ^ shift(seed));
+    }
+
+    Point2f next2D() {
+        uint32_t seed = qmc::hash(m_seed, m_dimension++);
+        uint32_t index = qmc::owenScramble(m_sampleIndex, seed);
+        uint32_t seedX = qmc::hash(seed, 0), seedY = qmc::hash(seed, 1);
+        return Point2f(
+            qmc::toFloat(qmc::owenScramble(qmc::sobol0(index), seedX) ^ shift(seedX)),
+            qmc::toFloat(qmc::owenScramble(qmc::sobol1(index), seedY) ^ shift(seedY))
+        );
+    }
+
+    std::string toString() const {
+        return tfm::format("BlueNoise[sampleCount=%i, seed=%i, maskSize=%i]",
+                           m_sampleCount, m_seed, NORI_BLUE_NOISE_SIZE);
+    }
+protected:
+    BlueNoise(const BlueNoiseMask &mask) : m_mask(mask) { }
+
+    /// Value of the mask at the current pixel, with a toroidal offset that depends on the seed
+    uint32_t shift(uint32_t seed) const {
+        return m_mask(m_pixel.x() + (seed & 0xffff), m_pixel.y() + (seed >> 16));
+    }
+
+private:
+    const BlueNoiseMask &m_mask;
+    uint32_t m_seed = 0;
+    Point2i m_pixel = Point2i(0, 0);
+    uint32_t m_sampleIndex = 0;
+    uint32_t m_dimension = 0;
+};
+
+NORI_REGISTER_CLASS(BlueNoise, "bluenoise");
+NORI_NAMESPACE_END
@@ -0,0 +1,104 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#include <nori/checkpoint.h>
+#include <nori/variance.h>
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+
+NORI_NAMESPACE_BEGIN
+
+static const char checkpointMagic[8] = { 'N', 'O', 'R', 'I', 'C', 'K', 'P', 'T' };
+static const uint32_t checkpointVersion = 1;
+
+void Checkpoint::save(const std::string &filename, const ImageBlock &result,
+                      const VarianceBuffer *variance) const {
+    std::string tempName = filename + ".tmp";
+    std::ofstream os(tempName, std::ios::binary);
+    if (!os.is_open())
+        throw NoriException("Unable to write checkpoint \"%s\"!", tempName);
+
+    int32_t header[7] = {
+        (int32_t) result.cols(), (int32_t) result.rows(), result.getBorderSize(),
+        result.getOffset().x(), result.getOffset().y(),
+        (int32_t) samplesDone, (int32_t) sampleTarget
+    };
+    uint8_t hasVariance = variance ? 1 : 0;
+
+    os.write(checkpointMagic, sizeof(checkpointMagic));
+    os.write((const char *) &checkpointVersion, sizeof(checkpointVersion));
+    os.write((const char *) header, sizeof(header));
+    os.write((const char *) &hasVariance, sizeof(hasVariance));
+
+    /* Unnormalized pixels and weights, including the border */
+    os.write((const char *) result.data(), sizeof(Color4f) * result.size());
+
+    if (variance)
+        variance->write(os);
+
+    os.close();
+    if (!os)
+        throw NoriException("Unable to write checkpoint \"%s\"!", tempName);
+
+    /* Replace the previous checkpoint (Windows refuses to rename onto an existing file) */
+    if (std::rename(tempName.c_str(), filename.c_str()) != 0) {
+        std::remove(filename.c_str());
+        if (std::rename(tempName.c_str(), filename.c_str()) != 0)
+            throw NoriException("Unable to replace checkpoint \"%s\"!", filename);
+    }
+}
+
+bool Checkpoint::load(const std::string &filename, ImageBlock &result,
+                      VarianceBuffer *variance) {
+    std::ifstream is(filename, std::ios::binary);
+    if (!is.is_open())
+        return false;
+
+    char magic[sizeof(checkpointMagic)];
+    uint32_t version = 0;
+    int32_t header[7];
+    uint8_t hasVariance = 0;
+
+    is.read(magic, sizeof(magic));
+    is.read((char *) &version, sizeof(version));
+    if (!is || memcmp(magic, checkpointMagic, sizeof(magic)) != 0)
+        throw NoriException("\"%s\" is not a valid checkpoint!", filename);
+    if (version != checkpointVersion)
+        throw NoriException("Checkpoint \"%s\" has version %i, but version %i is required!",
+                            filename, version, checkpointVersion);
+
+    is.read((char *) header, sizeof(header));
+    is.read((char *) &hasVariance, sizeof(hasVariance));
+    if (!is)
+        throw NoriException("Checkpoint \"%s\" is truncated!", filename);
+
+    if (header[0] != (int32_t) result.cols() || header[1] != (int32_t) result.rows() ||
+        header[2] != result.getBorderSize() || header[3] != result.getOffset().x() ||
+        header[4] != result.getOffset().y())
+        throw NoriException("Checkpoint \"%s\" was created for a different image size, "
+                            "crop window, or reconstruction filter!", filename);
+    if ((hasVariance != 0) != (variance != nullptr))
+        throw NoriException("Checkpoint \"%s\" was created %s adaptive sampling!",
+                            filename, hasVariance ? "with" : "without");
+
+    is.read((char *) result.data(), sizeof(Color4f) * result.size());
+    if (variance)
+        variance->read(is);
+    if (!is)
+        throw NoriException("Checkpoint \"%s\" is truncated!", filename);
+
+    samplesDone = (uint32_t) header[5];
+    sampleTarget = (uint32_t) header[6];
+    return true;
+}
+
+std::string Checkpoint::toString() const {
+    return tfm::format("Checkpoint[samplesDone=%i, sampleTarget=%i]",
+                       samplesDone, sampleTarget);
+}
+
+NORI_NAMESPACE_END
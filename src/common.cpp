@@ -222,6 +222,18 @@ Transform Transform::operator*(const Transform &t) const {
         t.m_inverse * m_inverse);
 }
 
+Transform Transform::lookAt(const Vector3f &origin, const Vector3f &target, const Vector3f &up) {
+    Vector3f dir = (target - origin).normalized();
+    Vector3f left = up.normalized().cross(dir).normalized();
+    Vector3f newUp = dir.cross(left).normalized();
+
+    Eigen::Matrix4f trafo;
+    trafo << left, newUp, dir, origin,
+              0, 0, 0, 1;
+
+    return Transform(trafo);
+}
+
 Vector3f sphericalDirection(float theta, float phi) {
     float sinTheta, cosTheta, sinPhi, cosPhi;
 
@@ -12,16 +12,46 @@
 #include <nanogui/layout.h>
 #include <nanogui/renderpass.h>
 #include <nanogui/texture.h>
+#include <GLFW/glfw3.h>
+#include <Eigen/Geometry>
+
+/// Height of the panel below the image
+#define NORI_GUI_PANEL_HEIGHT 36
 
 NORI_NAMESPACE_BEGIN
 
+int NoriScreen::previewDownsampling(const Vector2i &size) {
+    const GLFWvidmode *mode = glfwGetVideoMode(glfwGetPrimaryMonitor());
+    if (!mode)
+        return 1;
+
+    /* Leave some room for window decorations and the panel */
+    int maxWidth = std::max(mode->width * 9 / 10, 1);
+    int maxHeight = std::max(mode->height * 9 / 10 - NORI_GUI_PANEL_HEIGHT, 1);
+    return std::max(std::max((size.x() + maxWidth - 1) / maxWidth,
+                             (size.y() + maxHeight - 1) / maxHeight), 1);
+}
+
+nanogui::Vector2i NoriScreen::windowSize(const ImageBlock &block) {
+    int downsample = previewDownsampling(block.getSize());
+    return nanogui::Vector2i(
+        (block.getSize().x() + downsample - 1) / downsample,
+        (block.getSize().y() + downsample - 1) / downsample + NORI_GUI_PANEL_HEIGHT);
+}
+
 NoriScreen::NoriScreen(const ImageBlock &block)
- : nanogui::Screen(nanogui::Vector2i(block.getSize().x(), block.getSize().y() + 36),
-                   "Nori", false),
+ : nanogui::Screen(windowSize(block), "Nori", false),
    m_block(block) {
     using namespace nanogui;
     inc_ref();
 
+    /* Sizes of the displayed image and of the texture (which also contains
+       the border of the block), after downsampling */
+    int border = m_block.getBorderSize();
+    m_downsample = previewDownsampling(block.getSize());
+    m_viewSize = (block.getSize() + Vector2i::Constant(m_downsample - 1)) / m_downsample;
+    m_textureSize = (block.getSize() + Vector2i::Constant(2 * border + m_downsample - 1)) / m_downsample;
+
     /* Add some UI elements to adjust the exposure value */
     Widget *panel = new Widget(this);
     panel->set_layout(new BoxLayout(Orientation::Horizontal, Alignment::Middle, 10, 10));
@@ -35,11 +65,11 @@ NoriScreen::NoriScreen(const ImageBlock &block)
         }
     );
 
-    panel->set_size(nanogui::Vector2i(block.getSize().x(), block.getSize().y()));
+    panel->set_size(nanogui::Vector2i(m_viewSize.x(), m_viewSize.y()));
     perform_layout();
 
     panel->set_position(
-        nanogui::Vector2i((m_size.x() - panel->size().x()) / 2, block.getSize().y()));
+        nanogui::Vector2i((m_size.x() - panel->size().x()) / 2, m_viewSize.y()));
 
     /* Simple gamma tonemapper as a GLSL shader */
 
@@ -54,14 +84,17 @@ NoriScreen::NoriScreen(const ImageBlock &block)
         R"(#version 330
         uniform ivec2 size;
         uniform int borderSize;
+        uniform ivec2 textureSize;
+        uniform int downsample;
 
         in vec2 position;
         out vec2 uv;
         void main() {
             gl_Position = vec4(position.x * 2 - 1, position.y * 2 - 1, 0.0, 1.0);
 
-            // Crop away image border (due to pixel filter)
-            vec2 total_size = size + 2 * borderSize;
+            // Crop away image border (due to pixel filter). The texture
+            // may cover slightly more than that if it was downsampled
+            vec2 total_size = textureSize * downsample;
             vec2 scale = size / total_size;
             uv = vec2(position.x * scale.x + borderSize / total_size.x,
                       1 - (position.y * scale.y + borderSize / total_size.y));
@@ -101,14 +134,15 @@ NoriScreen::NoriScreen(const ImageBlock &block)
 
     const Vector2i &size = m_block.getSize();
     m_shader->set_uniform("size", nanogui::Vector2i(size.x(), size.y()));
-    m_shader->set_uniform("borderSize", m_block.getBorderSize());
+    m_shader->set_uniform("borderSize", border);
+    m_shader->set_uniform("textureSize", nanogui::Vector2i(m_textureSize.x(), m_textureSize.y()));
+    m_shader->set_uniform("downsample", m_downsample);
 
     // Allocate texture memory for the rendered image
     m_texture = new Texture(
         Texture::PixelFormat::RGBA,
         Texture::ComponentFormat::Float32,
-        nanogui::Vector2i(size.x() + 2 * m_block.getBorderSize(),
-                          size.y() + 2 * m_block.getBorderSize()),
+        nanogui::Vector2i(m_textureSize.x(), m_textureSize.y()),
         Texture::InterpolationMode::Nearest,
         Texture::InterpolationMode::Nearest);
 
@@ -117,24 +151,127 @@ NoriScreen::NoriScreen(const ImageBlock &block)
 }
 
 
+void NoriScreen::enableNavigation(const Transform &cameraToWorld, float fov, float moveSpeed,
+                                  const NavigationCallback &callback) {
+    m_origin = cameraToWorld * Point3f(0, 0, 0);
+    m_forward = (cameraToWorld * Vector3f(0, 0, 1)).normalized();
+    m_up = (cameraToWorld * Vector3f(0, 1, 0)).normalized();
+    m_fov = fov;
+    m_moveSpeed = moveSpeed;
+    m_navigationCallback = callback;
+
+    /* The camera is rebuilt from a look-at transformation, followed by
+       whatever else the original one did (e.g. mirror the x axis) */
+    m_handedness = Transform::lookAt(m_origin, m_origin + m_forward, m_up).inverse() * cameraToWorld;
+}
+
+void NoriScreen::updateCamera() {
+    m_navigationCallback(
+        Transform::lookAt(m_origin, m_origin + m_forward, m_up) * m_handedness, m_fov);
+}
+
+bool NoriScreen::mouse_motion_event(const nanogui::Vector2i &p, const nanogui::Vector2i &rel,
+                                    int button, int modifiers) {
+    if (Screen::mouse_motion_event(p, rel, button, modifiers))
+        return true;
+    if (!m_navigationCallback || !(button & (1 << GLFW_MOUSE_BUTTON_1)) || p.y() >= m_viewSize.y())
+        return false;
+
+    /* Turn around the up axis, and tilt around the horizontal axis unless
+       the camera would end up looking straight up or down */
+    const float speed = 0.005f;
+    Vector3f forward = Eigen::AngleAxisf(-rel.x() * speed, m_up) * m_forward;
+    Vector3f left = m_up.cross(forward).normalized();
+    Vector3f tilted = Eigen::AngleAxisf(rel.y() * speed, left) * forward;
+    if (std::abs(tilted.dot(m_up)) < 0.99f)
+        forward = tilted;
+    m_forward = forward.normalized();
+    updateCamera();
+    return true;
+}
+
+bool NoriScreen::scroll_event(const nanogui::Vector2i &p, const nanogui::Vector2f &rel) {
+    if (Screen::scroll_event(p, rel))
+        return true;
+    if (!m_navigationCallback)
+        return false;
+
+    /* Zoom by changing the field of view */
+    m_fov = clamp(m_fov * std::pow(1.1f, -rel.y()), 1.f, 170.f);
+    updateCamera();
+    return true;
+}
+
+bool NoriScreen::keyboard_event(int key, int scancode, int action, int modifiers) {
+    if (Screen::keyboard_event(key, scancode, action, modifiers))
+        return true;
+    if (!m_navigationCallback || (action != GLFW_PRESS && action != GLFW_REPEAT))
+        return false;
+
+    Vector3f left = m_up.cross(m_forward).normalized(), step;
+    switch (key) {
+        case GLFW_KEY_W: step =  m_forward; break;
+        case GLFW_KEY_S: step = -m_forward; break;
+        case GLFW_KEY_A: step =  left; break;
+        case GLFW_KEY_D: step = -left; break;
+        case GLFW_KEY_E: step =  m_up; break;
+        case GLFW_KEY_Q: step = -m_up; break;
+        default: return false;
+    }
+    m_origin += step * m_moveSpeed;
+    updateCamera();
+    return true;
+}
+
+void NoriScreen::upload(const BoundingBox2i &region) {
+    /* Range of texels that are affected by the region */
+    int f = m_downsample;
+    Point2i min(region.min.x() / f, region.min.y() / f);
+    Point2i max(region.max.x() / f, region.max.y() / f);
+    Vector2i size = max - min + Vector2i(1, 1);
+    m_upload.resize((size_t) size.x() * size.y() * 4);
+
+    /* Sum up the weighted pixels that map to each texel; the shader then
+       divides by the total weight, which averages them */
+    float *ptr = m_upload.data();
+    for (int y=min.y(); y<=max.y(); ++y) {
+        for (int x=min.x(); x<=max.x(); ++x) {
+            Color4f sum;
+            int endY = std::min((y + 1) * f, (int) m_snapshot.rows());
+            int endX = std::min((x + 1) * f, (int) m_snapshot.cols());
+            for (int sy=y*f; sy<endY; ++sy)
+                for (int sx=x*f; sx<endX; ++sx)
+                    sum += m_snapshot.coeff(sy, sx);
+            for (int i=0; i<4; ++i)
+                *ptr++ = sum[i];
+        }
+    }
+
+    m_texture->upload_sub_region((const uint8_t *) m_upload.data(),
+                                 nanogui::Vector2i(min.x(), min.y()),
+                                 nanogui::Vector2i(size.x(), size.y()));
+}
+
 void NoriScreen::draw_contents() {
-    // Reload the partially rendered image onto the GPU
-    m_block.lock();
-    const Vector2i &size = m_block.getSize();
+    // Upload the parts of the partially rendered image that changed since
+    // the last frame. Work on a snapshot, so that render threads are only
+    // blocked while the changed pixels are copied, not during the upload
+    m_block.snapshotChanges(m_snapshot, m_changed);
+    for (const BoundingBox2i &region : m_changed)
+        upload(region);
+
     m_shader->set_uniform("scale", m_scale);
     m_renderPass->resize(framebuffer_size());
     m_renderPass->begin();
     m_renderPass->set_viewport(nanogui::Vector2i(0, 0),
-                               nanogui::Vector2i(m_pixel_ratio * size[0],
-                                                 m_pixel_ratio * size[1]));
-    m_texture->upload((uint8_t *) m_block.data());
+                               nanogui::Vector2i(m_pixel_ratio * m_viewSize[0],
+                                                 m_pixel_ratio * m_viewSize[1]));
     m_shader->set_texture("source", m_texture);
     m_shader->begin();
     m_shader->draw_array(nanogui::Shader::PrimitiveType::Triangle, 0, 6, true);
     m_shader->end();
     m_renderPass->set_viewport(nanogui::Vector2i(0, 0), framebuffer_size());
     m_renderPass->end();
-    m_block.unlock();
 }
 
 NORI_NAMESPACE_END
@@ -0,0 +1,247 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#include <nori/sampler.h>
+#include <nori/block.h>
+#include <nori/qmc.h>
+#include <pcg32.h>
+#include <numeric>
+
+/* Number of dimensions with a prime base, beyond which the sampler
+   falls back to independent random numbers */
+#define NORI_HALTON_DIMENSIONS 256
+
+/* The first two dimensions are stretched over tiles of 2^7 x 3^5 pixels */
+#define NORI_HALTON_EXPONENT_X 7
+#define NORI_HALTON_EXPONENT_Y 5
+
+NORI_NAMESPACE_BEGIN
+
+/// Inverse of \ref qmc::scrambledRadicalInverse() (without a permutation) for \c digits digits
+static uint64_t inverseRadicalInverse(uint32_t base, uint64_t inverse, int digits) {
+    uint64_t index = 0;
+    for (int i=0; i<digits; ++i) {
+        uint64_t digit = inverse % base;
+        inverse /= base;
+        index = index * base + digit;
+    }
+    return index;
+}
+
+/// Return x such that a * x = 1 (mod n), where a and n are coprime
+static uint64_t multiplicativeInverse(int64_t a, int64_t n) {
+    /* Extended Euclidean algorithm */
+    int64_t x = 1, y = 0, r = a, s = n;
+    while (s != 0) {
+        int64_t q = r / s;
+        std::swap(x, y); y -= q * x;
+        std::swap(r, s); s -= q * r;
+    }
+    return (uint64_t) (((x % n) + n) % n);
+}
+
+/**
+ * \brief Halton sampler with random digit permutations
+ *
+ * Dimension \a i of every sample is the radical inverse of the sample
+ * index in the \a i-th prime base. The first two dimensions are scaled
+ * by 2^7 and 3^5, so that the first 2D points of the sequence cover a
+ * tile of 128 x 243 pixels, which repeats across the image. The sample
+ * indices that fall into a given pixel are found with the Chinese
+ * remainder theorem, as in PBRT: they are <tt>offset + k * stride</tt>,
+ * where \c offset only depends on the pixel coordinates modulo the tile
+ * size. The contributions of the x and y coordinates are precomputed
+ * once per sampler, and \ref prepare() looks them up for the columns and
+ * rows of a block, so that \ref generate() is just two loads.
+ *
+ * The remaining dimensions map their digits through random permutations,
+ * which removes the correlation between the higher (large) prime bases.
+ *
+ * Per pixel, the samples are stratified like a Halton sequence for any
+ * sample count, but counts that are multiples of 6 (2 x 3) stratify the
+ * pixel dimensions best.
+ */
+class Halton : public Sampler {
+public:
+    Halton(const PropertyList &propList) {
+        m_sampleCount = (size_t) propList.getInteger("sampleCount", 1);
+        m_seed = (uint32_t) propList.getInteger("seed", 0);
+        m_tables = std::make_shared<Tables>(m_seed);
+    }
+
+    virtual ~Halton() { }
+
+    std::unique_ptr<Sampler> clone() const {
+        std::unique_ptr<Halton> cloned(new Halton());
+        cloned->m_sampleCount = m_sampleCount;
+        cloned->m_sampleOffset = m_sampleOffset;
+        cloned->m_seed = m_seed;
+        cloned->m_tables = m_tables;
+        cloned->m_random = m_random;
+        return std::move(cloned);
+    }
+
+    void prepare(const ImageBlock &block) {
+        const Tables &t = *m_tables;
+        m_blockOffset = block.getOffset();
+        Vector2i size = block.getSize();
+
+        m_columnOffset.resize(size.x());
+        for (int x=0; x<size.x(); ++x)
+            m_columnOffset[x] = t.pixelOffsetX[mod(m_blockOffset.x() + x, (int) t.scaleX)];
+
+        m_rowOffset.resize(size.y());
+        for (int y=0; y<size.y(); ++y)
+            m_rowOffset[y] = t.pixelOffsetY[mod(m_blockOffset.y() + y, (int) t.scaleY)];
+
+        /* Dimensions beyond the prime table */
+        m_random.seed(
+            block.getOffset().x() + ((uint64_t) m_sampleOffset << 32),
+            block.getOffset().y()
+        );
+        m_index = m_sampleOffset * m_tables->stride;
+        m_dimension = 0;
+    }
+
+    /// \c pixel must lie within the block passed to \ref prepare()
+    void generate(const Point2i &pixel) {
+        uint64_t stride = m_tables->stride;
+        uint64_t offset = m_columnOffset[pixel.x() - m_blockOffset.x()] +
+                          m_rowOffset[pixel.y() - m_blockOffset.y()];
+        if (offset >= stride)
+            offset -= stride;
+        m_index = offset + m_sampleOffset * stride;
+        m_dimension = 0;
+    }
+
+    void advance() {
+        m_index += m_tables->stride;
+        m_dimension = 0;
+    }
+
+    float next1D() {
+        uint32_t dimension = m_dimension++;
+        if (dimension >= NORI_HALTON_DIMENSIONS)
+            return m_random.nextFloat();
+        return sample(dimension);
+    }
+
+    Point2f next2D() {
+        uint32_t dimension = m_dimension;
+        m_dimension += 2;
+        if (dimension + 1 >= NORI_HALTON_DIMENSIONS) {
+            float x = m_random.nextFloat();
+            return Point2f(x, m_random.nextFloat());
+        }
+        return Point2f(sample(dimension), sample(dimension + 1));
+    }
+
+    std::string toString() const {
+        return tfm::format("Halton[sampleCount=%i, seed=%i]", m_sampleCount, m_seed);
+    }
+protected:
+    Halton() { }
+
+    /// Prime bases, digit permutations and pixel offsets, shared by all clones
+    struct Tables {
+        uint32_t base[NORI_HALTON_DIMENSIONS];
+        /* Dimensions 0 and 1 remove the digits that select the pixel */
+        uint64_t divisor[NORI_HALTON_DIMENSIONS];
+        const uint16_t *permutation[NORI_HALTON_DIMENSIONS];
+        std::vector<uint16_t> permutations;
+
+        uint64_t scaleX, scaleY, stride;
+        std::vector<uint64_t> pixelOffsetX, pixelOffsetY;
+
+        Tables(uint32_t seed) {
+            /* The first NORI_HALTON_DIMENSIONS primes */
+            int count = 0;
+            for (uint32_t n = 2; count < NORI_HALTON_DIMENSIONS; ++n) {
+                bool prime = true;
+                for (int i=0; i<count && base[i] * base[i] <= n; ++i)
+                    prime &= n % base[i] != 0;
+                if (prime)
+                    base[count++] = n;
+            }
+
+            /* A random permutation of the digits of each base, except for
+               the pixel dimensions, whose digits must remain in place */
+            std::vector<size_t> start(NORI_HALTON_DIMENSIONS);
+            for (int i=0; i<NORI_HALTON_DIMENSIONS; ++i) {
+                start[i] = permutations.size();
+                size_t first = permutations.size();
+                for (uint32_t digit=0; digit<base[i]; ++digit)
+                    permutations.push_back((uint16_t) digit);
+                if (i >= 2) {
+                    pcg32 random(seed, i);
+                    random.shuffle(permutations.begin() + first, permutations.end());
+                }
+            }
+            for (int i=0; i<NORI_HALTON_DIMENSIONS; ++i) {
+                permutation[i] = permutations.data() + start[i];
+                divisor[i] = 1;
+            }
+
+            scaleX = 1ull << NORI_HALTON_EXPONENT_X;
+            scaleY = 1;
+            for (int i=0; i<NORI_HALTON_EXPONENT_Y; ++i)
+                scaleY *= 3;
+            stride = scaleX * scaleY;
+            divisor[0] = scaleX;
+            divisor[1] = scaleY;
+
+            /* Chinese remainder theorem: the sample index i of a pixel
+               satisfies i = a (mod scaleX) and i = b (mod scaleY) */
+            uint64_t inverseX = multiplicativeInverse((int64_t) scaleY, (int64_t) scaleX),
+                     inverseY = multiplicativeInverse((int64_t) scaleX, (int64_t) scaleY);
+            pixelOffsetX.resize(scaleX);
+            for (uint64_t x=0; x<scaleX; ++x)
+                pixelOffsetX[x] = inverseRadicalInverse(2, x, NORI_HALTON_EXPONENT_X)
+                    * (stride / scaleX) % stride * inverseX % stride;
+            pixelOffsetY.resize(scaleY);
+            for (uint64_t y=0; y<scaleY; ++y)
+                pixelOffsetY[y] = inverseRadicalInverse(3, y, NORI_HALTON_EXPONENT_Y)
+                    * (stride / scaleY) % stride * inverseY % stride;
+
+            /* Brute-force check that the sample indices of every pixel in the
+               tile land in it, i.e. that the low digits of the index reverse
+               to the pixel coordinates (index + k * stride has the same digits) */
+            for (uint64_t y=0; y<scaleY; ++y) {
+                for (uint64_t x=0; x<scaleX; ++x) {
+                    uint64_t index = (pixelOffsetX[x] + pixelOffsetY[y]) % stride;
+                    if (inverseRadicalInverse(2, index % scaleX, NORI_HALTON_EXPONENT_X) != x ||
+                        inverseRadicalInverse(3, index % scaleY, NORI_HALTON_EXPONENT_Y) != y)
+                        throw NoriException("Halton: sample index %i does not lie in pixel [%i, %i]!",
+                                            index, x, y);
+                }
+            }
+        }
+    };
+
+    /// Dimension \c dimension (below \c NORI_HALTON_DIMENSIONS) of the current sample
+    float sample(uint32_t dimension) const {
+        const Tables &t = *m_tables;
+        return qmc::scrambledRadicalInverse(t.base[dimension], m_index / t.divisor[dimension],
+                                            t.permutation[dimension]);
+    }
+
+    static int mod(int a, int b) {
+        int result = a % b;
+        return result < 0 ? result + b : result;
+    }
+
+private:
+    uint32_t m_seed = 0;
+    std::shared_ptr<const Tables> m_tables;
+    Point2i m_blockOffset = Point2i(0, 0);
+    std::vector<uint64_t> m_columnOffset, m_rowOffset;
+    uint64_t m_index = 0;
+    uint32_t m_dimension = 0;
+    pcg32 m_random;
+};
+
+NORI_REGISTER_CLASS(Halton, "halton");
+NORI_NAMESPACE_END
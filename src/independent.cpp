@@ -29,18 +29,20 @@ public:
     std::unique_ptr<Sampler> clone() const {
         std::unique_ptr<Independent> cloned(new Independent());
         cloned->m_sampleCount = m_sampleCount;
+        cloned->m_sampleOffset = m_sampleOffset;
         cloned->m_random = m_random;
         return std::move(cloned);
     }
 
     void prepare(const ImageBlock &block) {
+        /* Start a different sequence for every progressive pass */
         m_random.seed(
-            block.getOffset().x(),
+            block.getOffset().x() + ((uint64_t) m_sampleOffset << 32),
             block.getOffset().y()
         );
     }
 
-    void generate() { /* No-op for this sampler */ }
+    void generate(const Point2i &) { /* No-op for this sampler */ }
     void advance()  { /* No-op for this sampler */ }
 
     float next1D() {
@@ -0,0 +1,400 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#include <nori/lightbvh.h>
+#include <nori/emitter.h>
+#include <nori/timer.h>
+#include <Eigen/Geometry>
+
+NORI_NAMESPACE_BEGIN
+
+namespace {
+    /// Number of candidate split planes per axis
+    const int BUCKET_COUNT = 12;
+
+    inline float safeSqrt(float value) { return std::sqrt(std::max(0.f, value)); }
+    inline float safeAcos(float value) { return std::acos(clamp(value, -1.f, 1.f)); }
+
+    /// cos(max(0, a - b)) given the sines and cosines of a and b
+    inline float cosSubClamped(float sinA, float cosA, float sinB, float cosB) {
+        if (cosA > cosB)
+            return 1.f;
+        return cosA * cosB + sinA * sinB;
+    }
+
+    /// sin(max(0, a - b)) given the sines and cosines of a and b
+    inline float sinSubClamped(float sinA, float cosA, float sinB, float cosB) {
+        if (cosA > cosB)
+            return 0.f;
+        return sinA * cosB - cosA * sinB;
+    }
+
+    /// Surface area orientation heuristic for a candidate child node
+    float evaluateCost(const LightBounds &b, const BoundingBox3f &parent, int axis) {
+        if (b.phi == 0.f)
+            return 0.f;
+
+        float theta_o = safeAcos(b.cosTheta_o), theta_e = safeAcos(b.cosTheta_e);
+        float theta_w = std::min(theta_o + theta_e, M_PI);
+        float sinTheta_o = safeSqrt(1 - b.cosTheta_o * b.cosTheta_o);
+        float M_omega = 2 * M_PI * (1 - b.cosTheta_o) +
+            M_PI / 2 * (2 * theta_w * sinTheta_o - std::cos(theta_o - 2 * theta_w) -
+                        2 * theta_o * sinTheta_o + b.cosTheta_o);
+
+        /* Penalize thin slabs along the split axis */
+        Vector3f extents = parent.getExtents();
+        float Kr = extents.maxCoeff() / extents[axis];
+
+        return b.phi * M_omega * Kr * b.bbox.getSurfaceArea();
+    }
+}
+
+float LightBounds::importance(const Point3f &p, const Normal3f &n) const {
+    if (phi == 0.f)
+        return 0.f;
+
+    /* Distance to the center, clamped to avoid blowing up inside the box */
+    Point3f pc = bbox.getCenter();
+    float d2 = std::max((p - pc).squaredNorm(), bbox.getExtents().norm() / 2);
+
+    /* Angle between the cone axis and the direction towards the receiver */
+    Vector3f wi = (p - pc).normalized();
+    float cosTheta_w = w.dot(wi);
+    float sinTheta_w = safeSqrt(1 - cosTheta_w * cosTheta_w);
+
+    /* Bound the angle subtended by the box as seen from the receiver */
+    float radius2 = bbox.getExtents().squaredNorm() / 4;
+    float cosTheta_b = -1.f;
+    if ((p - pc).squaredNorm() > radius2)
+        cosTheta_b = safeSqrt(1 - radius2 / (p - pc).squaredNorm());
+    float sinTheta_b = safeSqrt(1 - cosTheta_b * cosTheta_b);
+
+    /* Minimum angle between any emitter normal and the receiver direction */
+    float sinTheta_o = safeSqrt(1 - cosTheta_o * cosTheta_o);
+    float cosTheta_x = cosSubClamped(sinTheta_w, cosTheta_w, sinTheta_o, cosTheta_o);
+    float sinTheta_x = sinSubClamped(sinTheta_w, cosTheta_w, sinTheta_o, cosTheta_o);
+    float cosThetap = cosSubClamped(sinTheta_x, cosTheta_x, sinTheta_b, cosTheta_b);
+    if (cosThetap <= cosTheta_e)
+        return 0.f;
+
+    float result = phi * cosThetap / d2;
+
+    /* Account for the foreshortening at the receiver */
+    if (!n.isZero()) {
+        float cosTheta_i = std::abs(wi.dot(n));
+        float sinTheta_i = safeSqrt(1 - cosTheta_i * cosTheta_i);
+        result *= cosSubClamped(sinTheta_i, cosTheta_i, sinTheta_b, cosTheta_b);
+    }
+
+    return std::max(result, 0.f);
+}
+
+LightBounds LightBounds::merge(const LightBounds &a, const LightBounds &b) {
+    if (a.phi == 0.f)
+        return b;
+    if (b.phi == 0.f)
+        return a;
+
+    LightBounds result;
+    result.bbox = BoundingBox3f::merge(a.bbox, b.bbox);
+    result.phi = a.phi + b.phi;
+    result.cosTheta_e = std::min(a.cosTheta_e, b.cosTheta_e);
+
+    /* Compute a cone that contains both normal cones */
+    float theta_a = safeAcos(a.cosTheta_o), theta_b = safeAcos(b.cosTheta_o);
+    float theta_d = safeAcos(a.w.dot(b.w));
+    if (std::min(theta_d + theta_b, M_PI) <= theta_a) {
+        result.w = a.w;
+        result.cosTheta_o = a.cosTheta_o;
+    } else if (std::min(theta_d + theta_a, M_PI) <= theta_b) {
+        result.w = b.w;
+        result.cosTheta_o = b.cosTheta_o;
+    } else {
+        float theta_o = (theta_a + theta_d + theta_b) / 2;
+        Vector3f axis = a.w.cross(b.w);
+        if (theta_o >= M_PI || axis.squaredNorm() == 0) {
+            /* Cone covers the entire sphere */
+            result.w = a.w;
+            result.cosTheta_o = -1.f;
+        } else {
+            result.w = Eigen::AngleAxisf(theta_o - theta_a, axis.normalized()) * a.w;
+            result.cosTheta_o = std::cos(theta_o);
+        }
+    }
+    return result;
+}
+
+std::string LightBounds::toString() const {
+    return tfm::format("LightBounds[bbox=%s, w=%s, phi=%f, cosTheta_o=%f, cosTheta_e=%f]",
+        bbox.toString(), w.toString(), phi, cosTheta_o, cosTheta_e);
+}
+
+void LightBVH::clear() {
+    m_lights.clear();
+    m_nodes.clear();
+    m_trail.clear();
+    m_lightIdx.clear();
+    m_meshOffset.clear();
+}
+
+void LightBVH::build(const std::vector<Mesh *> &emitters) {
+    clear();
+    if (emitters.empty())
+        return;
+
+    Timer timer;
+
+    /* Collect the bounds of every emissive triangle */
+    for (Mesh *mesh : emitters) {
+        m_meshOffset[mesh] = (uint32_t) m_lights.size();
+        float luminance = mesh->getEmitter()->getRadiance().getLuminance();
+        const MatrixXf &V = mesh->getVertexPositions();
+        const MatrixXf &N = mesh->getVertexNormals();
+        const MatrixXu &F = mesh->getIndices();
+
+        for (uint32_t i = 0; i < mesh->getTriangleCount(); ++i) {
+            Light light;
+            light.mesh = mesh;
+            light.triangle = i;
+            LightBounds &b = light.bounds;
+            b.bbox = mesh->getBoundingBox(i);
+            b.phi = luminance * mesh->surfaceArea(i);
+
+            Vector3f p0 = V.col(F(0, i)), p1 = V.col(F(1, i)), p2 = V.col(F(2, i));
+            Vector3f ng = (p1 - p0).cross(p2 - p0);
+            if (ng.squaredNorm() == 0)
+                b.phi = 0.f;
+            else
+                b.w = ng.normalized();
+
+            if (N.size() > 0 && b.phi > 0) {
+                /* Emission uses interpolated normals -- widen the cone */
+                float phi = b.phi;
+                for (int k = 0; k < 3; ++k) {
+                    LightBounds vb = b;
+                    vb.w = Vector3f(N.col(F(k, i))).normalized();
+                    vb.cosTheta_o = 1.f;
+                    b = LightBounds::merge(b, vb);
+                }
+                b.phi = phi;
+            }
+            m_lights.push_back(light);
+        }
+    }
+
+    m_trail.resize(m_lights.size());
+    m_nodes.reserve(2 * m_lights.size());
+    buildNode(0, (uint32_t) m_lights.size(), 0, 0);
+
+    /* Map (mesh, triangle) pairs to the final light positions */
+    m_lightIdx.resize(m_lights.size());
+    for (uint32_t i = 0; i < m_lights.size(); ++i)
+        m_lightIdx[m_meshOffset[m_lights[i].mesh] + m_lights[i].triangle] = i;
+
+    cout << "Light BVH: " << m_lights.size() << " emissive triangles, "
+         << m_nodes.size() << " nodes (took " << timer.elapsedString() << ")"
+         << endl;
+}
+
+uint32_t LightBVH::buildNode(uint32_t start, uint32_t end, uint64_t trail,
+                             int depth) {
+    uint32_t nodeIdx = (uint32_t) m_nodes.size();
+    m_nodes.emplace_back();
+
+    LightBounds bounds;
+    BoundingBox3f centroidBounds;
+    for (uint32_t i = start; i < end; ++i) {
+        bounds = LightBounds::merge(bounds, m_lights[i].bounds);
+        centroidBounds.expandBy(m_lights[i].bounds.bbox.getCenter());
+    }
+    if (!bounds.bbox.isValid())
+        bounds.bbox = centroidBounds;
+
+    /* Find the split with the lowest surface area orientation cost */
+    float bestCost = std::numeric_limits<float>::infinity();
+    int bestAxis = -1, bestBucket = -1;
+    if (end - start > 1 && depth < 64) {
+        for (int axis = 0; axis < 3; ++axis) {
+            float min = centroidBounds.min[axis], max = centroidBounds.max[axis];
+            if (max == min)
+                continue;
+
+            LightBounds buckets[BUCKET_COUNT];
+            uint32_t counts[BUCKET_COUNT] = { 0 };
+            for (uint32_t i = start; i < end; ++i) {
+                float c = m_lights[i].bounds.bbox.getCenter()[axis];
+                int b = std::min((int) (BUCKET_COUNT * (c - min) / (max - min)),
+                                 BUCKET_COUNT - 1);
+                buckets[b] = LightBounds::merge(buckets[b], m_lights[i].bounds);
+                counts[b]++;
+            }
+
+            for (int split = 0; split < BUCKET_COUNT - 1; ++split) {
+                LightBounds left, right;
+                uint32_t countLeft = 0, countRight = 0;
+                for (int b = 0; b <= split; ++b) {
+                    left = LightBounds::merge(left, buckets[b]);
+                    countLeft += counts[b];
+                }
+                for (int b = split + 1; b < BUCKET_COUNT; ++b) {
+                    right = LightBounds::merge(right, buckets[b]);
+                    countRight += counts[b];
+                }
+                if (countLeft == 0 || countRight == 0)
+                    continue;
+
+                float cost = evaluateCost(left, bounds.bbox, axis) +
+                             evaluateCost(right, bounds.bbox, axis);
+                if (cost < bestCost) {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestBucket = split;
+                }
+            }
+        }
+    }
+
+    if (bestAxis == -1) {
+        /* Single light, or lights that cannot be separated: make a leaf */
+        Node &node = m_nodes[nodeIdx];
+        node.bounds = bounds;
+        node.index = start;
+        node.count = end - start;
+        for (uint32_t i = start; i < end; ++i)
+            m_trail[i] = trail;
+        return nodeIdx;
+    }
+
+    float min = centroidBounds.min[bestAxis], max = centroidBounds.max[bestAxis];
+    Light *mid = std::partition(
+        m_lights.data() + start, m_lights.data() + end,
+        [&](const Light &light) {
+            float c = light.bounds.bbox.getCenter()[bestAxis];
+            int b = std::min((int) (BUCKET_COUNT * (c - min) / (max - min)),
+                             BUCKET_COUNT - 1);
+            return b <= bestBucket;
+        });
+    uint32_t split = (uint32_t) (mid - m_lights.data());
+
+    buildNode(start, split, trail, depth + 1);
+    uint32_t right = buildNode(split, end, trail | (1ull << depth), depth + 1);
+
+    Node &node = m_nodes[nodeIdx];
+    node.bounds = bounds;
+    node.index = right;
+    node.count = 0;
+    return nodeIdx;
+}
+
+int LightBVH::sampleLeaf(const Node &node, const Point3f &p, const Normal3f &n,
+                         float sample, float &pmf) const {
+    if (node.count == 1) {
+        pmf = node.bounds.importance(p, n) > 0 ? 1.f : 0.f;
+        return pmf > 0 ? (int) node.index : -1;
+    }
+
+    float total = 0.f;
+    for (uint32_t i = node.index; i < node.index + node.count; ++i)
+        total += m_lights[i].bounds.importance(p, n);
+    if (total == 0.f)
+        return -1;
+
+    float target = sample * total, accum = 0.f, importance = 0.f;
+    int chosen = -1;
+    for (uint32_t i = node.index; i < node.index + node.count; ++i) {
+        float value = m_lights[i].bounds.importance(p, n);
+        if (value == 0.f)
+            continue;
+        chosen = (int) i;
+        importance = value;
+        accum += value;
+        if (target < accum)
+            break;
+    }
+    pmf = importance / total;
+    return chosen;
+}
+
+bool LightBVH::sample(const Point3f &p, const Normal3f &n, float sample,
+                      const Mesh *&mesh, uint32_t &triangle, float &pmf) const {
+    if (m_nodes.empty())
+        return false;
+
+    uint32_t nodeIdx = 0;
+    pmf = 1.f;
+    while (!m_nodes[nodeIdx].isLeaf()) {
+        uint32_t left = nodeIdx + 1, right = m_nodes[nodeIdx].index;
+        float il = m_nodes[left].bounds.importance(p, n),
+              ir = m_nodes[right].bounds.importance(p, n);
+        if (il == 0.f && ir == 0.f)
+            return false;
+
+        /* Pick a child and rescale the sample so that it can be reused */
+        float probLeft = il / (il + ir);
+        if (sample < probLeft) {
+            sample = std::min(sample / probLeft, 0.99999994f);
+            pmf *= probLeft;
+            nodeIdx = left;
+        } else {
+            sample = std::min((sample - probLeft) / (1 - probLeft), 0.99999994f);
+            pmf *= 1 - probLeft;
+            nodeIdx = right;
+        }
+    }
+
+    float leafPmf;
+    int index = sampleLeaf(m_nodes[nodeIdx], p, n, sample, leafPmf);
+    if (index < 0)
+        return false;
+
+    pmf *= leafPmf;
+    mesh = m_lights[index].mesh;
+    triangle = m_lights[index].triangle;
+    return true;
+}
+
+float LightBVH::pmf(const Point3f &p, const Normal3f &n, const Mesh *mesh,
+                    uint32_t triangle) const {
+    auto it = m_meshOffset.find(mesh);
+    if (it == m_meshOffset.end())
+        return 0.f;
+    uint32_t lightIdx = m_lightIdx[it->second + triangle];
+    uint64_t trail = m_trail[lightIdx];
+
+    /* Follow the recorded path from the root down to the leaf */
+    uint32_t nodeIdx = 0;
+    float result = 1.f;
+    while (!m_nodes[nodeIdx].isLeaf()) {
+        uint32_t left = nodeIdx + 1, right = m_nodes[nodeIdx].index;
+        float il = m_nodes[left].bounds.importance(p, n),
+              ir = m_nodes[right].bounds.importance(p, n);
+        if (il == 0.f && ir == 0.f)
+            return 0.f;
+        if (trail & 1) {
+            result *= ir / (il + ir);
+            nodeIdx = right;
+        } else {
+            result *= il / (il + ir);
+            nodeIdx = left;
+        }
+        trail >>= 1;
+    }
+
+    const Node &node = m_nodes[nodeIdx];
+    float total = 0.f;
+    for (uint32_t i = node.index; i < node.index + node.count; ++i)
+        total += m_lights[i].bounds.importance(p, n);
+    if (total == 0.f)
+        return 0.f;
+    return result * m_lights[lightIdx].bounds.importance(p, n) / total;
+}
+
+std::string LightBVH::toString() const {
+    return tfm::format("LightBVH[lights=%i, nodes=%i]",
+        m_lights.size(), m_nodes.size());
+}
+
+NORI_NAMESPACE_END
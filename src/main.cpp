@@ -13,18 +13,100 @@
 #include <nori/sampler.h>
 #include <nori/integrator.h>
 #include <nori/gui.h>
+#include <nori/variance.h>
+#include <nori/scheduler.h>
+#include <nori/wavefront.h>
+#include <nori/checkpoint.h>
+#include <nori/streaming.h>
+#include <nori/rfilter.h>
+#include <nori/tev.h>
+#include <nori/reload.h>
+#include <nori/accel.h>
+#include <nori/warp.h>
+#include <pcg32.h>
 #include <tbb/parallel_for.h>
 #include <tbb/blocked_range.h>
 #include <tbb/task_scheduler_init.h>
 #include <filesystem/resolver.h>
 #include <thread>
+#include <mutex>
+#include <atomic>
+#include <csignal>
+#include <cstdio>
 
 using namespace nori;
 
 static int threadCount = -1;
+static int blockSize = -1; /* Automatic by default */
 static bool gui = true;
+static bool wavefront = false;
+static int interleave = 8;   /* Interleaved ray traversals (wavefront mode) */
+static bool filterSampling = false; /* Importance sample the reconstruction filter instead of splatting */
+static std::string tevAddress;      /* Send the render in progress to tev at this address */
+static bool benchmark = false;
 
-static void renderBlock(const Scene *scene, Sampler *sampler, ImageBlock &block) {
+/* Progressive rendering: render passes of 'sppPerPass' samples over the
+   whole image until 'sppLimit' samples or 'timeLimit' seconds are reached */
+static bool progressive = false;
+static int sppPerPass = 1;
+static int sppLimit = -1;
+static double timeLimit = -1;
+
+/* Adaptive sampling: after each progressive pass, only pixels whose relative
+   error exceeds 'adaptiveThreshold' receive further samples */
+static bool adaptive = false;
+static float adaptiveThreshold = 0.01f;
+static const uint32_t adaptiveMinSamples = 16;
+
+/* Checkpointing: progressive renders save their state to '<scene>.ckpt'
+   every 'checkpointInterval' seconds and when they are stopped early.
+   With 'resume', a render continues from an existing checkpoint. */
+static double checkpointInterval = -1;
+static bool resume = false;
+
+/* Sharded rendering: this process renders shard 'shardIndex' out of
+   'shardCount', i.e. a contiguous range of the samples of every pixel */
+static bool sharded = false;
+static int shardIndex = 0;
+static int shardCount = 1;
+
+/* Streaming output: finished tiles are written to a tiled OpenEXR file
+   right away, instead of keeping the whole image in memory */
+static bool streaming = false;
+
+/* Compression and precision of the OpenEXR output */
+static EXROptions exrOptions;
+
+/* Crop window (x, y, width, height) that overrides the one of the camera */
+static int crop[4] = { 0, 0, 0, 0 };
+
+/* Service mode: keep the scene in memory and render jobs read from stdin */
+static bool serve = false;
+
+/* Interactive mode: the camera can be moved in the preview window. Every
+   change restarts the accumulation with a pass at 1/'previewSubsampling'
+   of the resolution, which full-resolution passes then refine */
+static bool interactiveMode = false;
+
+/* Watch mode: interactive mode that also applies edits of the scene file */
+static bool watch = false;
+static const int previewSubsampling = 4;
+static const float previewWeight = 1e-3f;
+
+/* Set when the user asks to stop (Ctrl-C or closing the preview window).
+   Progressive renders finish the current pass and write their output. */
+static std::atomic<bool> stopRequested(false);
+
+static void handleInterrupt(int) {
+    stopRequested = true;
+    /* A second Ctrl-C terminates immediately */
+    std::signal(SIGINT, SIG_DFL);
+}
+
+/// Render the rows of a piece of work, and return how many there were
+static int renderBlock(const Scene *scene, Sampler *sampler, ImageBlock &block, uint32_t sampleCount,
+                       TileScheduler &scheduler, int piece, const FilterSampler *filterSampler,
+                       VarianceBuffer *variance = nullptr) {
     const Camera *camera = scene->getCamera();
     const Integrator *integrator = scene->getIntegrator();
 
@@ -34,11 +116,34 @@ static void renderBlock(const Scene *scene, Sampler *sampler, ImageBlock &block)
     /* Clear the block contents */
     block.clear();
 
-    /* For each pixel and pixel sample sample */
-    for (int y=0; y<size.y(); ++y) {
+    /* Splatted samples are passed to the block in batches */
+    Point2f batchPositions[NORI_SPLAT_BATCH];
+    Color3f batchValues[NORI_SPLAT_BATCH];
+    int batchSize = 0;
+
+    /* For each pixel and pixel sample sample (rows are claimed one at
+       a time, since idle threads may steal some of them) */
+    int y, rows = 0;
+    while (scheduler.nextRow(piece, y)) {
+        ++rows;
         for (int x=0; x<size.x(); ++x) {
-            for (uint32_t i=0; i<sampler->getSampleCount(); ++i) {
-                Point2f pixelSample = Point2f((float) (x + offset.x()), (float) (y + offset.y())) + sampler->next2D();
+            Point2i pixel(x + offset.x(), y + offset.y());
+
+            /* Skip pixels that have already converged */
+            if (variance && !variance->isActive(pixel))
+                continue;
+
+            sampler->generate(pixel);
+            for (uint32_t i=0; i<sampleCount; ++i) {
+                /* Either draw the sample position from the filter, or
+                   uniformly within the pixel (and splat it later) */
+                Point2f pixelSample;
+                float weight = 1.f;
+                if (filterSampler)
+                    pixelSample = Point2f(pixel.x() + 0.5f, pixel.y() + 0.5f)
+                        + filterSampler->sample(sampler->next2D(), weight);
+                else
+                    pixelSample = Point2f((float) pixel.x(), (float) pixel.y()) + sampler->next2D();
                 Point2f apertureSample = sampler->next2D();
 
                 /* Sample a ray from the camera */
@@ -49,24 +154,118 @@ static void renderBlock(const Scene *scene, Sampler *sampler, ImageBlock &block)
                 value *= integrator->Li(scene, sampler, ray);
 
                 /* Store in the image block */
-                block.put(pixelSample, value);
+                if (filterSampler) {
+                    block.put(pixel, value, weight);
+                } else {
+                    batchPositions[batchSize] = pixelSample;
+                    batchValues[batchSize++] = value;
+                    if (batchSize == NORI_SPLAT_BATCH) {
+                        block.put(batchSize, batchPositions, batchValues);
+                        batchSize = 0;
+                    }
+                }
+
+                /* Update the error estimate of the pixel */
+                if (variance)
+                    variance->put(pixel, value);
+
+                sampler->advance();
             }
         }
     }
+
+    block.put(batchSize, batchPositions, batchValues);
+    return rows;
+}
+
+/// Like \ref renderBlock(), but trace the paths in wavefront order
+static int renderBlockWavefront(const Scene *scene, Sampler *sampler, ImageBlock &block,
+                                 uint32_t sampleCount, TileScheduler &scheduler, int piece,
+                                 WavefrontRenderer &renderer, VarianceBuffer *variance = nullptr) {
+    Point2i offset = block.getOffset();
+    Vector2i size  = block.getSize();
+
+    /* Clear the block contents */
+    block.clear();
+
+    /* Queue the samples of entire rows, and trace them once there are enough */
+    int y, rows = 0;
+    while (scheduler.nextRow(piece, y)) {
+        ++rows;
+        for (int x=0; x<size.x(); ++x) {
+            Point2i pixel(x + offset.x(), y + offset.y());
+
+            /* Skip pixels that have already converged */
+            if (variance && !variance->isActive(pixel))
+                continue;
+
+            renderer.generate(sampler, pixel, sampleCount);
+        }
+
+        if (renderer.getPathCount() >= NORI_WAVEFRONT_BATCH)
+            renderer.render(sampler, block, variance);
+    }
+
+    renderer.render(sampler, block, variance);
+    return rows;
 }
 
-static void render(Scene *scene, const std::string &filename) {
+/// Render the scene (whose integrator must have been preprocessed) and write the output
+static void render(Scene *scene, const std::string &filename, int spp = -1) {
     const Camera *camera = scene->getCamera();
     Vector2i outputSize = camera->getOutputSize();
-    scene->getIntegrator()->preprocess(scene);
 
-    /* Create a block generator (i.e. a work scheduler) */
-    BlockGenerator blockGenerator(outputSize, NORI_BLOCK_SIZE);
+    /* Only the crop window is rendered (by default, the entire image) */
+    Point2i cropOffset = camera->getCropOffset();
+    Vector2i cropSize = camera->getCropSize();
+
+    /* Create a work scheduler that splits the image into blocks */
+    int workerCount = threadCount > 0 ? threadCount : tbb::task_scheduler_init::default_num_threads();
+    int tileSize = blockSize > 0 ? blockSize : BlockGenerator::autoBlockSize(cropSize, workerCount);
+    TileScheduler scheduler(cropSize, tileSize, workerCount, cropOffset);
 
-    /* Allocate memory for the entire output image and clear it */
-    ImageBlock result(outputSize, camera->getReconstructionFilter());
+    /* With filter importance sampling, every sample only contributes to
+       one pixel, so that the image blocks don't need a border */
+    const ReconstructionFilter *filter = camera->getReconstructionFilter();
+    std::unique_ptr<FilterSampler> filterSampler;
+    if (filterSampling) {
+        filterSampler.reset(new FilterSampler(filter));
+        filter = nullptr;
+    }
+
+    /* Allocate memory for the entire output image and clear it (unless
+       the finished tiles are streamed to disk) */
+    ImageBlock result(streaming ? Vector2i(0, 0) : cropSize, filter);
+    result.setOffset(cropOffset);
     result.clear();
 
+    /* Per-pixel error estimates for adaptive sampling */
+    std::unique_ptr<VarianceBuffer> variance;
+    if (adaptive)
+        variance.reset(new VarianceBuffer(cropSize, cropOffset));
+
+    /* Determine the filename of the output bitmap */
+    std::string outputName = filename;
+    size_t lastdot = outputName.find_last_of(".");
+    if (lastdot != std::string::npos)
+        outputName.erase(lastdot, std::string::npos);
+
+    std::unique_ptr<StreamingOutput> stream;
+    if (streaming)
+        stream.reset(new StreamingOutput(outputName + ".exr", outputSize, cropOffset, cropSize,
+                                         tileSize, filter, exrOptions));
+
+    /* Continue an interrupted render */
+    std::string checkpointName = outputName + ".ckpt";
+    Checkpoint checkpoint;
+    if (resume) {
+        if (checkpoint.load(checkpointName, result, variance.get()))
+            cout << "Resuming from \"" << checkpointName << "\" ("
+                 << checkpoint.samplesDone << " spp done)" << endl;
+        else
+            cout << "No checkpoint \"" << checkpointName << "\" found, starting from scratch" << endl;
+    }
+
     /* Create a window that visualizes the partially rendered result */
     NoriScreen *screen = nullptr;
     if (gui) {
@@ -74,88 +273,604 @@ static void render(Scene *scene, const std::string &filename) {
         screen = new NoriScreen(result);
     }
 
-    /* Do the following in parallel and asynchronously */
-    std::thread render_thread([&] {
-        tbb::task_scheduler_init init(threadCount);
+    /* Alternatively, send it to a tev instance (which may run elsewhere) */
+    std::unique_ptr<TevClient> tev;
+    if (!tevAddress.empty()) {
+        try {
+            tev.reset(new TevClient(tevAddress, outputName, result));
+        } catch (const NoriException &e) {
+            cerr << "Warning: " << e.what() << ", rendering without a preview" << endl;
+        }
+    }
 
-        cout << "Rendering .. ";
-        cout.flush();
-        Timer timer;
+    /* Render 'sampleCount' samples per pixel, starting at sample 'sampleOffset' */
+    auto renderPass = [&](uint32_t sampleOffset, uint32_t sampleCount) {
+        scheduler.reset();
 
-        tbb::blocked_range<int> range(0, blockGenerator.getBlockCount());
+        /* One task per worker, each of which keeps requesting work */
+        tbb::blocked_range<int> range(0, scheduler.getWorkerCount(), 1);
 
         auto map = [&](const tbb::blocked_range<int> &range) {
             /* Allocate memory for a small image block to be rendered
                by the current thread */
-            ImageBlock block(Vector2i(NORI_BLOCK_SIZE),
-                             camera->getReconstructionFilter());
+            ImageBlock block(Vector2i(tileSize), filter);
 
             /* Create a clone of the sampler for the current thread */
             std::unique_ptr<Sampler> sampler(scene->getSampler()->clone());
+            sampler->setSampleOffset(sampleOffset);
 
-            for (int i=range.begin(); i<range.end(); ++i) {
-                /* Request an image block from the block generator */
-                blockGenerator.next(block);
+            /* Ray and path queues for wavefront rendering */
+            std::unique_ptr<WavefrontRenderer> renderer;
+            if (wavefront)
+                renderer.reset(new WavefrontRenderer(scene, (uint32_t) interleave,
+                                                     filterSampler.get()));
 
-                /* Inform the sampler about the block to be rendered */
-                sampler->prepare(block);
+            for (int worker=range.begin(); worker<range.end(); ++worker) {
+                /* Request an image block (or part of one) from the scheduler */
+                int piece;
+                while ((piece = scheduler.next(worker, block)) >= 0) {
+                    /* Skip blocks that have converged entirely */
+                    if (variance && !variance->isActive(block)) {
+                        scheduler.skip(piece);
+                        scheduler.done(worker, piece);
+                        continue;
+                    }
 
-                /* Render all contained pixels */
-                renderBlock(scene, sampler.get(), block);
+                    /* Inform the sampler about the block to be rendered */
+                    sampler->prepare(block);
 
-                /* The image block has been processed. Now add it to
-                   the "big" block that represents the entire image */
-                result.put(block);
+                    /* Render all contained pixels */
+                    int rows;
+                    if (renderer)
+                        rows = renderBlockWavefront(scene, sampler.get(), block, sampleCount,
+                                                    scheduler, piece, *renderer, variance.get());
+                    else
+                        rows = renderBlock(scene, sampler.get(), block, sampleCount,
+                                           scheduler, piece, filterSampler.get(), variance.get());
+
+                    /* The image block has been processed. Now add it to
+                       the "big" block that represents the entire image */
+                    if (stream)
+                        stream->put(block, rows);
+                    else
+                        result.put(block);
+                    scheduler.done(worker, piece);
+                }
             }
         };
 
         /// Default: parallel rendering
-        tbb::parallel_for(range, map);
+        tbb::parallel_for(range, map, tbb::simple_partitioner());
 
         /// (equivalent to the following single-threaded call)
         // map(range);
+    };
+
+    /* Do the following in parallel and asynchronously */
+    std::thread render_thread([&] {
+        tbb::task_scheduler_init init(threadCount);
+
+        uint32_t sampleCount = (uint32_t) (spp > 0 ? spp : scene->getSampler()->getSampleCount());
+        Timer timer;
+
+        if (sharded) {
+            /* The samplers derive their seeds from the sample offset, so
+               the shards are decorrelated from each other */
+            uint32_t begin = (uint32_t) ((uint64_t) sampleCount * shardIndex / shardCount),
+                     end = (uint32_t) ((uint64_t) sampleCount * (shardIndex + 1) / shardCount);
+            cout << "Rendering shard " << shardIndex << "/" << shardCount
+                 << " (samples " << begin << " to " << end << ") .. ";
+            cout.flush();
+
+            if (end > begin)
+                renderPass(begin, end - begin);
+
+            cout << "done. (took " << timer.elapsedString() << ")" << endl;
+            return;
+        }
 
-        cout << "done. (took " << timer.elapsedString() << ")" << endl;
+        if (!progressive) {
+            cout << "Rendering .. ";
+            cout.flush();
+
+            renderPass(0, sampleCount);
+
+            cout << "done. (took " << timer.elapsedString() << ")" << endl;
+            cout << scheduler.getUtilization() << endl;
+            return;
+        }
+
+        /* Progressive mode: every pass adds 'sppPerPass' samples to all
+           pixels. The accumulated weights keep the image normalized, so
+           the render may stop after any pass. */
+        uint32_t limit = sppLimit > 0 ? (uint32_t) sppLimit :
+            (checkpoint.sampleTarget > 0 ? checkpoint.sampleTarget : sampleCount);
+        uint32_t samplesDone = checkpoint.samplesDone;
+        double lastPass = 0;
+        bool converged = false;
+        Timer checkpointTimer;
+
+        /* Save the state between passes, while no thread touches the image */
+        auto saveCheckpoint = [&]() {
+            checkpoint.samplesDone = samplesDone;
+            checkpoint.sampleTarget = limit;
+            checkpoint.save(checkpointName, result, variance.get());
+            checkpointTimer.reset();
+            cout << "  saved checkpoint \"" << checkpointName << "\"" << endl;
+        };
+
+        cout << "Rendering progressively (" << sppPerPass << " spp per pass, up to "
+             << limit << " spp";
+        if (timeLimit > 0)
+            cout << " or " << timeString(timeLimit * 1000);
+        cout << ") .." << endl;
+
+        while (samplesDone < limit && !stopRequested) {
+            /* Don't start a pass that is expected to exceed the time budget */
+            double elapsed = timer.elapsed() / 1000.0;
+            if (timeLimit > 0 && samplesDone > 0 && elapsed + lastPass > timeLimit)
+                break;
+
+            uint32_t count = std::min((uint32_t) sppPerPass, limit - samplesDone);
+            Timer passTimer;
+            renderPass(samplesDone, count);
+            samplesDone += count;
+            lastPass = passTimer.elapsed() / 1000.0;
+
+            if (!variance) {
+                cout << "  " << samplesDone << " spp (pass took "
+                     << passTimer.elapsedString() << ")" << endl;
+            } else {
+                /* Adaptive sampling: find the pixels that still need samples */
+                size_t active = variance->update(adaptiveThreshold, adaptiveMinSamples, limit);
+                cout << "  up to " << samplesDone << " spp, "
+                     << tfm::format("%.1f", 100.0 * active / ((double) cropSize.x() * cropSize.y()))
+                     << "% of the pixels active (pass took " << passTimer.elapsedString() << ")" << endl;
+                converged = active == 0;
+            }
+
+            if (converged)
+                break;
+            if (checkpointInterval > 0 && samplesDone < limit &&
+                checkpointTimer.elapsed() / 1000.0 >= checkpointInterval)
+                saveCheckpoint();
+        }
+
+        /* Keep the checkpoint of an unfinished render, and drop it otherwise */
+        if (samplesDone < limit && !converged) {
+            if (checkpointInterval > 0 || resume)
+                saveCheckpoint();
+        } else if (resume || checkpointInterval > 0) {
+            std::remove(checkpointName.c_str());
+        }
+
+        cout << "done. (" << samplesDone << " spp, took "
+             << timer.elapsedString() << ")" << endl;
+        cout << scheduler.getUtilization() << endl;
     });
 
     /* Enter the application main loop */
-    if (gui)
+    if (gui) {
         nanogui::mainloop(50.f);
 
+        /* Closing the window ends a progressive render after the current pass */
+        stopRequested = true;
+    }
+
     /* Shut down the user interface */
     render_thread.join();
+    tev.reset();
 
     if (gui) {
         delete screen;
         nanogui::shutdown();
     }
 
+    /* All tiles have already been written */
+    if (stream) {
+        cout << "Wrote " << stream->getWrittenTiles() << " tiles, at most "
+             << stream->getPeakTiles() << " of which were in memory at the same time" << endl;
+        return;
+    }
+
+    /* Shards are written without normalization, so that nori-merge can
+       add up the weighted values and filter weights of all shards (which
+       may also be the crop windows of different processes) */
+    if (sharded) {
+        result.saveWeightedEXR(tfm::format("%s_shard%iof%i", outputName, shardIndex, shardCount), outputSize);
+        return;
+    }
+
     /* Now turn the rendered image block into
        a properly normalized bitmap */
     std::unique_ptr<Bitmap> bitmap(result.toBitmap());
 
-    /* Determine the filename of the output bitmap */
+    /* Save using the OpenEXR format */
+    bitmap->saveEXR(outputName, cropOffset, outputSize, exrOptions);
+
+    /* Save tonemapped (sRGB) output using the PNG format */
+    bitmap->savePNG(outputName);
+
+    /* Save the number of samples that each pixel received */
+    if (variance) {
+        std::unique_ptr<Bitmap> sampleCounts(variance->toBitmap());
+        sampleCounts->saveEXR(outputName + "_spp", cropOffset, outputSize, exrOptions);
+    }
+}
+
+/**
+ * Compare straight-line against interleaved BVH traversal on one thread.
+ * Uses one camera ray through the center of every pixel, followed by one
+ * diffuse bounce from each hit point, which accesses memory much less
+ * coherently.
+ */
+static void benchmarkTraversal(const Scene *scene) {
+    const Camera *camera = scene->getCamera();
+    const Accel *accel = scene->getAccel();
+    Vector2i size = camera->getOutputSize();
+    uint32_t count = (uint32_t) (size.x() * size.y());
+
+    std::vector<Ray3f> primary(count);
+    for (int y=0; y<size.y(); ++y)
+        for (int x=0; x<size.x(); ++x)
+            camera->sampleRay(primary[y * size.x() + x],
+                Point2f(x + 0.5f, y + 0.5f), Point2f(0.5f, 0.5f));
+
+    std::vector<Intersection> its(count);
+    std::unique_ptr<bool[]> hit(new bool[count]), reference(new bool[count]);
+    accel->rayIntersect(count, primary.data(), its.data(), hit.get(), false, 1);
+
+    std::vector<Ray3f> secondary;
+    pcg32 random;
+    for (uint32_t i=0; i<count; ++i) {
+        if (!hit[i])
+            continue;
+        Vector3f d = Warp::squareToUniformSphere(Point2f(random.nextFloat(), random.nextFloat()));
+        if (d.dot(its[i].shFrame.n) < 0)
+            d = -d;
+        secondary.push_back(Ray3f(its[i].p, d));
+    }
+
+    auto run = [&](const char *name, const std::vector<Ray3f> &rays) {
+        uint32_t n = (uint32_t) rays.size();
+        std::vector<Intersection> refIts(n), testIts(n);
+        Timer timer;
+        for (uint32_t i=0; i<n; ++i)
+            reference[i] = accel->rayIntersect(rays[i], refIts[i]);
+        double straight = timer.elapsed();
+        cout << tfm::format("  %s rays (%i): straight-line %.2f Mrays/s", name, n,
+                            n / (1000.0 * std::max(straight, 1e-3))) << endl;
+
+        for (uint32_t k=1; k<=NORI_MAX_INTERLEAVE; k *= 2) {
+            timer.reset();
+            accel->rayIntersect(n, rays.data(), testIts.data(), hit.get(), false, k);
+            double elapsed = timer.elapsed();
+
+            uint32_t mismatches = 0;
+            for (uint32_t i=0; i<n; ++i)
+                if (hit[i] != reference[i] || (hit[i] && (testIts[i].t != refIts[i].t ||
+                                                          testIts[i].mesh != refIts[i].mesh)))
+                    ++mismatches;
+
+            cout << tfm::format("    interleave %2i: %.2f Mrays/s (%.2fx)", k,
+                                n / (1000.0 * std::max(elapsed, 1e-3)),
+                                straight / std::max(elapsed, 1e-3));
+            if (mismatches > 0)
+                cout << tfm::format(", %i MISMATCHES", mismatches);
+            cout << endl;
+        }
+    };
+
+    cout << "Benchmarking BVH traversal (single thread) .." << endl;
+    run("Camera", primary);
+    run("Diffuse", secondary);
+}
+
+/**
+ * Render a sequence of jobs without reloading the scene. Every line of
+ * the standard input describes one job as a list of key=value pairs:
+ *
+ *   output=<file.exr> [spp=N] [fov=degrees] [crop=x,y,width,height]
+ *   [origin=x,y,z target=x,y,z up=x,y,z]
+ *
+ * Camera overrides only apply to the job that specifies them. The line
+ * "quit" (or the end of the input) terminates the service.
+ */
+static void serveJobs(Scene *scene, const std::string &sceneName) {
+    Camera *camera = const_cast<Camera *>(scene->getCamera());
+    Transform cameraToWorld = camera->getCameraToWorld();
+    float fov = camera->getFov();
+    Point2i cropOffset = camera->getCropOffset();
+    Vector2i cropSize = camera->getCropSize();
+
+    /* Jobs only change the camera, so the integrator is set up once */
+    scene->getIntegrator()->preprocess(scene);
+
+    cout << "Ready to render jobs from \"" << sceneName << "\"" << endl;
+
+    std::string line;
+    int jobIndex = 0;
+    while (std::getline(std::cin, line)) {
+        std::vector<std::string> tokens = tokenize(line, " \t\r");
+        if (tokens.empty())
+            continue;
+        if (tokens.size() == 1 && tokens[0] == "quit")
+            break;
+
+        Timer timer;
+        ++jobIndex;
+        try {
+            std::string output;
+            int spp = -1;
+            Vector3f origin, target, up;
+            int lookAtValues = 0;
+
+            for (const std::string &token : tokens) {
+                size_t pos = token.find('=');
+                if (pos == std::string::npos)
+                    throw NoriException("Expected key=value, got \"%s\"", token);
+                std::string key = token.substr(0, pos), value = token.substr(pos + 1);
+
+                if (key == "output")
+                    output = value;
+                else if (key == "spp")
+                    spp = toInt(value);
+                else if (key == "fov")
+                    camera->setFov(toFloat(value));
+                else if (key == "crop") {
+                    std::vector<std::string> values = tokenize(value);
+                    if (values.size() != 4)
+                        throw NoriException("Expected a crop window x,y,width,height");
+                    camera->setCropWindow(Point2i(toInt(values[0]), toInt(values[1])),
+                                          Vector2i(toInt(values[2]), toInt(values[3])));
+                }
+                else if (key == "origin")
+                    origin = toVector3f(value), lookAtValues |= 1;
+                else if (key == "target")
+                    target = toVector3f(value), lookAtValues |= 2;
+                else if (key == "up")
+                    up = toVector3f(value), lookAtValues |= 4;
+                else
+                    throw NoriException("Unknown job parameter \"%s\"", key);
+            }
+
+            if (output.empty())
+                throw NoriException("The job does not specify an output file");
+            if (lookAtValues == 7)
+                camera->setCameraToWorld(Transform::lookAt(origin, target, up));
+            else if (lookAtValues != 0)
+                throw NoriException("\"origin\", \"target\", and \"up\" must be specified together");
+
+            render(scene, output, spp);
+            cout << tfm::format("Job %i done: \"%s\" (took %s)", jobIndex, output,
+                                timer.elapsedString()) << endl;
+        } catch (const std::exception &e) {
+            cerr << tfm::format("Job %i failed: %s", jobIndex, e.what()) << endl;
+        }
+
+        /* Restore the camera of the scene for the next job */
+        camera->setCameraToWorld(cameraToWorld);
+        camera->setFov(fov);
+        camera->setCropWindow(cropOffset, cropSize);
+    }
+}
+
+/**
+ * Render a quick preview with one sample for every square of
+ * 'previewSubsampling'^2 pixels. The samples are added with a tiny weight,
+ * so that the pixels take on the values of the first full-resolution
+ * samples as soon as those arrive.
+ */
+static void renderPreview(const Scene *scene, ImageBlock &result, const std::atomic<bool> &restart) {
+    const Camera *camera = scene->getCamera();
+    const Integrator *integrator = scene->getIntegrator();
+    Point2i offset = result.getOffset();
+    Vector2i size = result.getSize();
+    int f = previewSubsampling, rowCount = (size.y() + f - 1) / f;
+
+    tbb::parallel_for(tbb::blocked_range<int>(0, rowCount),
+        [&](const tbb::blocked_range<int> &range) {
+            ImageBlock block(Vector2i(size.x(), f), nullptr);
+            std::unique_ptr<Sampler> sampler(scene->getSampler()->clone());
+
+            for (int row=range.begin(); row!=range.end() && !restart; ++row) {
+                block.setOffset(Point2i(offset.x(), offset.y() + row * f));
+                block.setSize(Vector2i(size.x(), std::min(f, size.y() - row * f)));
+                block.clear();
+                sampler->prepare(block);
+
+                for (int x=0; x<size.x(); x += f) {
+                    Point2i corner(offset.x() + x, offset.y() + row * f);
+                    Vector2i extent(std::min(f, size.x() - x), block.getSize().y());
+
+                    Ray3f ray;
+                    sampler->generate(corner);
+                    Color3f value = camera->sampleRay(ray,
+                        Point2f(corner.x() + 0.5f * extent.x(), corner.y() + 0.5f * extent.y()),
+                        sampler->next2D());
+                    value *= integrator->Li(scene, sampler.get(), ray);
+
+                    for (int py=0; py<extent.y(); ++py)
+                        for (int px=0; px<extent.x(); ++px)
+                            block.put(Point2i(corner.x() + px, corner.y() + py), value, previewWeight);
+                }
+                result.put(block);
+            }
+        });
+}
+
+static void interactive(std::unique_ptr<NoriObject> &root, const std::string &filename) {
+    Scene *scene = static_cast<Scene *>(root.get());
+    Camera *camera = const_cast<Camera *>(scene->getCamera());
+    Point2i cropOffset = camera->getCropOffset();
+    Vector2i cropSize = camera->getCropSize();
+    scene->getIntegrator()->preprocess(scene);
+
+    int workerCount = threadCount > 0 ? threadCount : tbb::task_scheduler_init::default_num_threads();
+    int tileSize = blockSize > 0 ? blockSize : BlockGenerator::autoBlockSize(cropSize, workerCount);
+    TileScheduler scheduler(cropSize, tileSize, workerCount, cropOffset);
+
+    ImageBlock result(cropSize, camera->getReconstructionFilter());
+    result.setOffset(cropOffset);
+    result.clear();
+
+    /* Camera changes made in the window, which the render thread applies
+       before it restarts */
+    std::mutex cameraMutex;
+    Transform cameraToWorld = camera->getCameraToWorld();
+    float fov = camera->getFov();
+    std::atomic<bool> restart(true), quit(false);
+
+    /* The camera of the scene file, to tell whether an edit moved it */
+    std::unique_ptr<SceneReloader> reloader;
+    if (watch)
+        reloader.reset(new SceneReloader(filename));
+    Transform fileCameraToWorld = cameraToWorld;
+    float fileFov = fov;
+
+    nanogui::init();
+    NoriScreen *screen = new NoriScreen(result);
+    float moveSpeed = scene->getBoundingBox().getExtents().norm() * 0.01f;
+    NoriScreen::NavigationCallback navigate =
+        [&](const Transform &newCameraToWorld, float newFov) {
+            std::lock_guard<std::mutex> lock(cameraMutex);
+            cameraToWorld = newCameraToWorld;
+            fov = newFov;
+            restart = true;
+        };
+    screen->enableNavigation(cameraToWorld, fov, moveSpeed, navigate);
+
+    std::thread render_thread([&] {
+        tbb::task_scheduler_init init(threadCount);
+        uint32_t limit = (uint32_t) (sppLimit > 0 ? sppLimit : scene->getSampler()->getSampleCount());
+        uint32_t samplesDone = 0;
+        auto nextPoll = std::chrono::steady_clock::now();
+
+        while (!quit) {
+            /* Apply edits of the scene file between passes */
+            if (reloader && std::chrono::steady_clock::now() >= nextPoll) {
+                nextPoll = std::chrono::steady_clock::now() + std::chrono::milliseconds(250);
+                if (reloader->poll()) {
+                    try {
+                        SceneReloader::EChange change = reloader->reload(root);
+                        if (change != SceneReloader::ENone) {
+                            scene = static_cast<Scene *>(root.get());
+                            camera = const_cast<Camera *>(scene->getCamera());
+                            camera->setCropWindow(cropOffset, cropSize);
+                            if (change != SceneReloader::ECamera)
+                                scene->getIntegrator()->preprocess(scene);
+                            limit = (uint32_t) (sppLimit > 0 ? sppLimit : scene->getSampler()->getSampleCount());
+
+                            /* Only a camera that was edited in the file replaces
+                               the one that was navigated to in the window */
+                            if (camera->getCameraToWorld().getMatrix() != fileCameraToWorld.getMatrix() ||
+                                camera->getFov() != fileFov) {
+                                fileCameraToWorld = camera->getCameraToWorld();
+                                fileFov = camera->getFov();
+                                float moveSpeed = scene->getBoundingBox().getExtents().norm() * 0.01f;
+                                std::lock_guard<std::mutex> lock(cameraMutex);
+                                cameraToWorld = fileCameraToWorld;
+                                fov = fileFov;
+                                nanogui::async([=, &navigate] {
+                                    screen->enableNavigation(fileCameraToWorld, fileFov, moveSpeed, navigate);
+                                });
+                            }
+                            cout << "Reloaded \"" << filename << "\"" << endl;
+                            restart = true;
+                        }
+                    } catch (const std::exception &e) {
+                        cerr << "Error while reloading \"" << filename
+                             << "\", keeping the previous scene: " << e.what() << endl;
+                    }
+                }
+            }
+
+            if (restart) {
+                {
+                    std::lock_guard<std::mutex> lock(cameraMutex);
+                    camera->setCameraToWorld(cameraToWorld);
+                    camera->setFov(fov);
+                    restart = false;
+                }
+                result.clearLocked();
+                renderPreview(scene, result, restart);
+                samplesDone = 0;
+                continue;
+            }
+
+            /* Idle once the image is refined */
+            if (samplesDone >= limit) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                continue;
+            }
+
+            /* Refine, unless the camera moves in the meantime */
+            uint32_t count = std::min((uint32_t) sppPerPass, limit - samplesDone);
+            scheduler.reset();
+            tbb::parallel_for(tbb::blocked_range<int>(0, workerCount, 1),
+                [&](const tbb::blocked_range<int> &range) {
+                    ImageBlock block(Vector2i(tileSize), camera->getReconstructionFilter());
+                    std::unique_ptr<Sampler> sampler(scene->getSampler()->clone());
+                    sampler->setSampleOffset(samplesDone);
+
+                    for (int worker=range.begin(); worker<range.end(); ++worker) {
+                        int piece;
+                        while ((piece = scheduler.next(worker, block)) >= 0) {
+                            if (restart || quit) {
+                                scheduler.skip(piece);
+                            } else {
+                                sampler->prepare(block);
+                                renderBlock(scene, sampler.get(), block, count, scheduler, piece, nullptr);
+                                result.put(block);
+                            }
+                            scheduler.done(worker, piece);
+                        }
+                    }
+                }, tbb::simple_partitioner());
+            samplesDone += count;
+        }
+    });
+
+    nanogui::mainloop(50.f);
+    quit = true;
+    render_thread.join();
+    delete screen;
+    nanogui::shutdown();
+
+    /* Print the final camera, so that it can be pasted into the scene file */
+    Point3f origin = cameraToWorld * Point3f(0, 0, 0);
+    Point3f target = origin + cameraToWorld * Vector3f(0, 0, 1);
+    Vector3f up = cameraToWorld * Vector3f(0, 1, 0);
+    cout << tfm::format("Final camera: <lookat origin=\"%f, %f, %f\" target=\"%f, %f, %f\" "
+                        "up=\"%f, %f, %f\"/> (fov %f)", origin.x(), origin.y(), origin.z(),
+                        target.x(), target.y(), target.z(), up.x(), up.y(), up.z(), fov) << endl;
+
+    /* Save the image as it was when the window was closed */
     std::string outputName = filename;
     size_t lastdot = outputName.find_last_of(".");
     if (lastdot != std::string::npos)
         outputName.erase(lastdot, std::string::npos);
-
-    /* Save using the OpenEXR format */
-    bitmap->saveEXR(outputName);
-
-    /* Save tonemapped (sRGB) output using the PNG format */
+    std::unique_ptr<Bitmap> bitmap(result.toBitmap());
+    bitmap->saveEXR(outputName, cropOffset, camera->getOutputSize(), exrOptions);
     bitmap->savePNG(outputName);
 }
 
 int main(int argc, char **argv) {
     if (argc < 2) {
-        cerr << "Syntax: " << argv[0] << " <scene.xml> [--no-gui] [--threads N]" <<  endl;
+        cerr << "Syntax: " << argv[0] << " <scene.xml> [--no-gui] [--threads N] [--block-size N] [--wavefront] [--interleave N] [--progressive]"
+                " [--spp-per-pass N] [--spp-limit N] [--time-limit seconds] [--adaptive error]"
+                " [--checkpoint seconds] [--resume] [--shard i/N] [--crop x,y,w,h] [--stream] [--serve]"
+                " [--exr-compression codec] [--half] [--filter-sampling] [--tev host:port] [--interactive] [--watch]"
+                " [--benchmark-traversal]" <<  endl;
         return -1;
     }
 
     std::string sceneName = "";
     std::string exrName = "";
 
+    /* Options that were given explicitly (rather than implied by others) */
+    bool progressiveGiven = false, interleaveGiven = false;
+
     for (int i = 1; i < argc; ++i) {
         std::string token(argv[i]);
         if (token == "-t" || token == "--threads") {
@@ -169,6 +884,7 @@ int main(int argc, char **argv) {
                 cerr << "\"--threads\" argument expects a positive integer following it." << endl;
                 return -1;
             }
+            exrOptions.threadCount = threadCount;
 
             continue;
         }
@@ -176,6 +892,155 @@ int main(int argc, char **argv) {
             gui = false;
             continue;
         }
+        else if (token == "--block-size") {
+            blockSize = i+1 < argc ? atoi(argv[i+1]) : 0;
+            if (blockSize <= 0) {
+                cerr << "\"--block-size\" argument expects a positive integer following it." << endl;
+                return -1;
+            }
+            i++;
+            continue;
+        }
+        else if (token == "--wavefront") {
+            wavefront = true;
+            continue;
+        }
+        else if (token == "--interleave") {
+            interleave = i+1 < argc ? atoi(argv[i+1]) : 0;
+            interleaveGiven = true;
+            if (interleave <= 0 || interleave > NORI_MAX_INTERLEAVE) {
+                cerr << "\"--interleave\" argument expects an integer between 1 and "
+                     << NORI_MAX_INTERLEAVE << " following it." << endl;
+                return -1;
+            }
+            i++;
+            continue;
+        }
+        else if (token == "--checkpoint") {
+            checkpointInterval = i+1 < argc ? atof(argv[i+1]) : 0;
+            if (checkpointInterval <= 0) {
+                cerr << "\"--checkpoint\" argument expects a positive number of seconds following it." << endl;
+                return -1;
+            }
+            progressive = true;
+            i++;
+            continue;
+        }
+        else if (token == "--resume") {
+            resume = progressive = true;
+            continue;
+        }
+        else if (token == "--shard") {
+            if (i+1 >= argc || sscanf(argv[i+1], "%i/%i", &shardIndex, &shardCount) != 2 ||
+                shardCount < 1 || shardIndex < 0 || shardIndex >= shardCount) {
+                cerr << "\"--shard\" argument expects a shard index and count (e.g. 0/4) following it." << endl;
+                return -1;
+            }
+            sharded = true;
+            i++;
+            continue;
+        }
+        else if (token == "--crop") {
+            if (i+1 >= argc || sscanf(argv[i+1], "%i,%i,%i,%i", &crop[0], &crop[1], &crop[2], &crop[3]) != 4 ||
+                crop[2] <= 0 || crop[3] <= 0) {
+                cerr << "\"--crop\" argument expects a crop window x,y,width,height following it." << endl;
+                return -1;
+            }
+            i++;
+            continue;
+        }
+        else if (token == "--stream") {
+            /* There is no complete image that could be previewed */
+            streaming = true;
+            gui = false;
+            continue;
+        }
+        else if (token == "--exr-compression") {
+            try {
+                exrOptions.compression = EXROptions::parseCompression(i+1 < argc ? argv[i+1] : "");
+            } catch (const std::exception &e) {
+                cerr << "\"--exr-compression\" argument: " << e.what() << endl;
+                return -1;
+            }
+            i++;
+            continue;
+        }
+        else if (token == "--tev") {
+            /* Previews through tev instead of the window */
+            tevAddress = i+1 < argc ? argv[i+1] : "";
+            if (tevAddress.empty() || tevAddress[0] == '-') {
+                cerr << "\"--tev\" argument expects the address of a tev instance (e.g. "
+                     << NORI_TEV_ADDRESS << ") following it." << endl;
+                return -1;
+            }
+            gui = false;
+            i++;
+            continue;
+        }
+        else if (token == "--filter-sampling") {
+            filterSampling = true;
+            continue;
+        }
+        else if (token == "--half") {
+            exrOptions.half = true;
+            continue;
+        }
+        else if (token == "--serve") {
+            serve = true;
+            gui = false;
+            continue;
+        }
+        else if (token == "--interactive") {
+            interactiveMode = true;
+            continue;
+        }
+        else if (token == "--watch") {
+            interactiveMode = true;
+            watch = true;
+            continue;
+        }
+        else if (token == "--benchmark-traversal") {
+            benchmark = true;
+            continue;
+        }
+        else if (token == "--progressive") {
+            progressive = progressiveGiven = true;
+            continue;
+        }
+        else if (token == "--spp-per-pass" || token == "--spp-limit") {
+            int value = i+1 < argc ? atoi(argv[i+1]) : 0;
+            if (value <= 0) {
+                cerr << "\"" << token << "\" argument expects a positive integer following it." << endl;
+                return -1;
+            }
+            if (token == "--spp-per-pass")
+                sppPerPass = value;
+            else
+                sppLimit = value;
+            progressive = true;
+            i++;
+            continue;
+        }
+        else if (token == "--adaptive") {
+            adaptiveThreshold = i+1 < argc ? (float) atof(argv[i+1]) : 0;
+            if (adaptiveThreshold <= 0) {
+                cerr << "\"--adaptive\" argument expects a positive relative error following it." << endl;
+                return -1;
+            }
+            adaptive = progressive = true;
+            i++;
+            continue;
+        }
+        else if (token == "--time-limit") {
+            timeLimit = i+1 < argc ? atof(argv[i+1]) : 0;
+            if (timeLimit <= 0) {
+                cerr << "\"--time-limit\" argument expects a positive number of seconds following it." << endl;
+                return -1;
+            }
+            progressive = true;
+            i++;
+            continue;
+        }
 
         filesystem::path path(argv[i]);
 
@@ -200,6 +1065,41 @@ int main(int argc, char **argv) {
         }
     }
 
+    if (sharded && progressive) {
+        cerr << "Sharded rendering can't be combined with progressive rendering." << endl;
+        return -1;
+    }
+
+    if (streaming && (progressive || sharded)) {
+        cerr << "Streaming output can't be combined with progressive or sharded rendering." << endl;
+        return -1;
+    }
+
+    if (interactiveMode && (!gui || sharded)) {
+        cerr << "Interactive mode needs the preview window, and can't be combined with sharded rendering." << endl;
+        return -1;
+    }
+
+    /* Interactive mode always refines the image in passes of --spp-per-pass
+       samples (up to --spp-limit), and splats them with the block renderer */
+    if (interactiveMode && (progressiveGiven || adaptive || timeLimit > 0 ||
+                            checkpointInterval > 0 || resume)) {
+        cerr << "Interactive mode can't be combined with --progressive, --adaptive, --time-limit,"
+                " --checkpoint or --resume (it always renders progressively, see --spp-per-pass"
+                " and --spp-limit)." << endl;
+        return -1;
+    }
+
+    if (interactiveMode && (wavefront || interleaveGiven || filterSampling)) {
+        cerr << "Interactive mode can't be combined with --wavefront, --interleave or --filter-sampling." << endl;
+        return -1;
+    }
+
+    if (streaming && !tevAddress.empty()) {
+        cerr << "Streaming output can't be combined with --tev, since there is no complete image to send." << endl;
+        return -1;
+    }
+
     if (exrName !="" && sceneName !="") {
         cerr << "Both .xml and .exr files were provided. Please only provide one of them." << endl;
         return -1;
@@ -232,10 +1132,33 @@ int main(int argc, char **argv) {
             threadCount = tbb::task_scheduler_init::automatic;
         }
         try {
+            /* Meshes are loaded in parallel, using the requested number of threads */
+            tbb::task_scheduler_init init(threadCount);
             std::unique_ptr<NoriObject> root(loadFromXML(sceneName));
             /* When the XML root object is a scene, start rendering it .. */
-            if (root->getClassType() == NoriObject::EScene)
-                render(static_cast<Scene *>(root.get()), sceneName);
+            if (root->getClassType() == NoriObject::EScene) {
+                Scene *scene = static_cast<Scene *>(root.get());
+                if (crop[2] > 0)
+                    const_cast<Camera *>(scene->getCamera())->setCropWindow(
+                        Point2i(crop[0], crop[1]), Vector2i(crop[2], crop[3]));
+                if (benchmark) {
+                    benchmarkTraversal(scene);
+                    return 0;
+                }
+                if (serve) {
+                    /* The worker threads of 'init' stay alive between jobs */
+                    serveJobs(scene, sceneName);
+                    return 0;
+                }
+                if (interactiveMode) {
+                    interactive(root, sceneName);
+                    return 0;
+                }
+                if (progressive)
+                    std::signal(SIGINT, handleInterrupt);
+                scene->getIntegrator()->preprocess(scene);
+                render(scene, sceneName);
+            }
         } catch (const std::exception &e) {
             cerr << e.what() << endl;
             return -1;
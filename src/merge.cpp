@@ -0,0 +1,57 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+/* =======================================================================
+     Merge the weighted shards of a render that was split across several
+     processes or machines (see 'nori --shard i/N') into a final image.
+ * ======================================================================= */
+
+#include <nori/block.h>
+#include <nori/bitmap.h>
+#include <ImfInputFile.h>
+
+using namespace nori;
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        cerr << "Syntax: " << argv[0] << " <output.exr> <shard.exr> [<shard.exr> ...]" << endl;
+        return -1;
+    }
+
+    std::string outputName = argv[1];
+    size_t lastdot = outputName.find_last_of(".");
+    if (lastdot != std::string::npos)
+        outputName.erase(lastdot, std::string::npos);
+
+    try {
+        /* The display window of the first shard determines the image size */
+        Vector2i size;
+        {
+            Imf::InputFile file(argv[2]);
+            Imath::Box2i dw = file.header().displayWindow();
+            size = Vector2i(dw.max.x - dw.min.x + 1, dw.max.y - dw.min.y + 1);
+        }
+
+        /* Sum up the weighted color values and filter weights of all shards
+           (each of which may only cover a part of the image) */
+        ImageBlock result(size, nullptr);
+        result.clear();
+        for (int i = 2; i < argc; ++i) {
+            cout << "Adding \"" << argv[i] << "\"" << endl;
+            result.addWeightedEXR(argv[i]);
+        }
+
+        /* Normalize the sum, just like a single render would */
+        std::unique_ptr<Bitmap> bitmap(result.toBitmap());
+        bitmap->saveEXR(outputName);
+        bitmap->savePNG(outputName);
+    } catch (const std::exception &e) {
+        cerr << "Fatal error: " << e.what() << endl;
+        return -1;
+    }
+
+    return 0;
+}
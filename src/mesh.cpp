@@ -28,14 +28,19 @@ void Mesh::activate() {
         m_bsdf = static_cast<BSDF *>(
             NoriObjectFactory::createInstance("diffuse", PropertyList()));
     }
-    m_dpdf.clear();
-    // build dpdf
-    float wholeSurfaceArea = 0;
-    for (uint32_t idx = 0; idx < getTriangleCount(); idx++) {
-        wholeSurfaceArea += surfaceArea(idx);
-    }
-    for (uint32_t idx = 0; idx < getTriangleCount(); idx++) {
-        m_dpdf.append(surfaceArea(idx) / wholeSurfaceArea);
+
+    /* Precompute the tables needed for sampling positions on emitters.
+       Other meshes are never sampled, so there is no point in paying
+       for this (in memory and loading time) */
+    m_areaTable.clear();
+    m_surfaceArea = m_invSurfaceArea = 0.0f;
+    if (isEmitter()) {
+        std::vector<float> areas(getTriangleCount());
+        for (uint32_t idx = 0; idx < getTriangleCount(); ++idx)
+            areas[idx] = surfaceArea(idx);
+        m_surfaceArea = m_areaTable.build(areas);
+        if (m_surfaceArea > 0)
+            m_invSurfaceArea = 1.0f / m_surfaceArea;
     }
 }
 
@@ -119,30 +124,55 @@ void Mesh::addChild(NoriObject *obj) {
     }
 }
 
-float Mesh::samplePosition(Point2f random, Point3f &sample, Normal3f &normal) {
-    float pdf;
-    uint32_t index = m_dpdf.sample(random[0], pdf);
-    float a = 1 - sqrt(1 - random[0]);
-    float b = random[1] * sqrt(1 - random[0]);
+void Mesh::replaceChild(NoriObject *obj) {
+    switch (obj->getClassType()) {
+        case EBSDF:
+            delete m_bsdf;
+            m_bsdf = static_cast<BSDF *>(obj);
+            break;
+
+        case EEmitter:
+            delete m_emitter;
+            m_emitter = static_cast<Emitter *>(obj);
+            break;
+
+        default:
+            throw NoriException("Mesh::replaceChild(<%s>) is not supported!",
+                                classTypeName(obj->getClassType()));
+    }
+    obj->setParent(this);
+}
+
+float Mesh::samplePosition(const Point2f &sample, Point3f &p,
+                           Normal3f &n) const {
+    if (m_areaTable.size() == 0)
+        throw NoriException(
+            "Mesh::samplePosition(): no sampling tables (is this an emitter?)");
+
+    /* Choose a triangle and reuse the sample to place a point on it */
+    Point2f uv(sample);
+    uint32_t index = (uint32_t) m_areaTable.sampleReuse(uv.x());
+    sampleTriangle(index, uv, p, n);
+
+    return m_invSurfaceArea;
+}
+
+void Mesh::sampleTriangle(uint32_t index, const Point2f &sample, Point3f &p,
+                          Normal3f &n) const {
+    float su = std::sqrt(1 - sample.x());
+    float a = 1 - su, b = sample.y() * su;
 
     uint32_t i0 = m_F(0, index), i1 = m_F(1, index), i2 = m_F(2, index);
     const Point3f p0 = m_V.col(i0), p1 = m_V.col(i1), p2 = m_V.col(i2);
-    sample = a * p0 + b * p1 + (1 - a - b) * p2;
+    p = a * p0 + b * p1 + (1 - a - b) * p2;
 
     if (m_N.size() != 0) {
         const Normal3f n0 = m_N.col(i0), n1 = m_N.col(i1), n2 = m_N.col(i2);
-        normal = a * n0 + b * n1 + (1 - a - b) * n2;
+        n = a * n0 + b * n1 + (1 - a - b) * n2;
     } else {
-        normal = Vector3f(p1 - p0).cross(p2 - p0);
+        n = Vector3f(p1 - p0).cross(p2 - p0);
     }
-    normal.normalize();
-
-    float wholeSurfaceArea = 0;
-    for (uint32_t idx = 0; idx < getTriangleCount(); idx++) {
-        wholeSurfaceArea += surfaceArea(idx);
-    }
-
-    return 1 / wholeSurfaceArea;
+    n.normalize();
 }
 
 std::string Mesh::toString() const {
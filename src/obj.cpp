@@ -28,8 +28,6 @@ public:
             throw NoriException("Unable to open OBJ file \"%s\"!", filename);
         Transform trafo = propList.getTransform("toWorld", Transform());
 
-        cout << "Loading \"" << filename << "\" .. ";
-        cout.flush();
         Timer timer;
 
         std::vector<Vector3f>   positions;
@@ -112,11 +110,13 @@ public:
         }
 
         m_name = filename.str();
-        cout << "done. (V=" << m_V.cols() << ", F=" << m_F.cols() << ", took "
-             << timer.elapsedString() << " and "
-             << memString(m_F.size() * sizeof(uint32_t) +
-                          sizeof(float) * (m_V.size() + m_N.size() + m_UV.size()))
-             << ")" << endl;
+
+        /* Several meshes may be loading concurrently: print a single line */
+        cout << tfm::format("Loading \"%s\" .. done. (V=%i, F=%i, took %s and %s)\n",
+                            filename, m_V.cols(), m_F.cols(), timer.elapsedString(),
+                            memString(m_F.size() * sizeof(uint32_t) +
+                                      sizeof(float) * (m_V.size() + m_N.size() + m_UV.size())));
+        cout.flush();
     }
 
 protected:
@@ -8,32 +8,38 @@
 #include <nori/proplist.h>
 #include <Eigen/Geometry>
 #include <pugixml.hpp>
+#include <tbb/task_group.h>
+#include <exception>
 #include <fstream>
+#include <iterator>
+#include <deque>
 #include <set>
 
 NORI_NAMESPACE_BEGIN
 
 NoriObject *loadFromXML(const std::string &filename) {
-    /* Load the XML file using 'pugi' (a tiny self-contained XML parser implemented in C++) */
+    std::ifstream is(filename, std::ios::binary);
+    if (!is.good())
+        throw NoriException("Error while parsing \"%s\": could not open the file", filename);
+    std::string xml((std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
+    return loadFromXMLString(xml, filename);
+}
+
+NoriObject *loadFromXMLString(const std::string &xml, const std::string &filename) {
+    /* Load the XML document using 'pugi' (a tiny self-contained XML parser implemented in C++) */
     pugi::xml_document doc;
-    pugi::xml_parse_result result = doc.load_file(filename.c_str());
+    pugi::xml_parse_result result = doc.load_buffer(xml.data(), xml.size());
 
     /* Helper function: map a position offset in bytes to a more readable line/column value */
     auto offset = [&](ptrdiff_t pos) -> std::string {
-        std::fstream is(filename);
-        char buffer[1024];
-        int line = 0, linestart = 0, offset = 0;
-        while (is.good()) {
-            is.read(buffer, sizeof(buffer));
-            for (int i = 0; i < is.gcount(); ++i) {
-                if (buffer[i] == '\n') {
-                    if (offset + i >= pos)
-                        return tfm::format("line %i, col %i", line + 1, pos - linestart);
-                    ++line;
-                    linestart = offset + i;
-                }
+        int line = 0, linestart = 0;
+        for (ptrdiff_t i = 0; i < (ptrdiff_t) xml.size(); ++i) {
+            if (xml[i] == '\n') {
+                if (i >= pos)
+                    return tfm::format("line %i, col %i", line + 1, pos - linestart);
+                ++line;
+                linestart = (int) i;
             }
-            offset += (int) is.gcount();
         }
         return "byte offset " + std::to_string(pos);
     };
@@ -117,9 +123,69 @@ NoriObject *loadFromXML(const std::string &filename) {
 
     Eigen::Affine3f transform;
 
+    /* Instantiated objects. Meshes dominate the loading time (OBJ parsing
+       and the construction of sampling tables) and do not depend on each
+       other, so they are constructed and activated by parallel tasks. These
+       are joined before the parent object (normally the scene) receives its
+       children, so the parent still sees them in file order. */
+    struct ParsedObject {
+        NoriObject *object = nullptr;
+        std::exception_ptr error;
+        bool deferred = false;
+    };
+    std::deque<ParsedObject> objects;
+
+    /* Helper function: instantiate, assemble and activate an object */
+    auto instantiate = [&](const pugi::xml_node &node, int tag, const PropertyList &propList,
+                           const std::vector<ParsedObject *> &children) -> NoriObject * {
+        check_attributes(node, { "type" });
+
+        /* This is an object, first instantiate it */
+        NoriObject *result = NoriObjectFactory::createInstance(
+            node.attribute("type").value(),
+            propList
+        );
+
+        if (result->getClassType() != (int) tag) {
+            throw NoriException(
+                "Unexpectedly constructed an object "
+                "of type <%s> (expected type <%s>): %s",
+                NoriObject::classTypeName(result->getClassType()),
+                NoriObject::classTypeName((NoriObject::EClassType) tag),
+                result->toString());
+        }
+
+        /* Add all children */
+        for (auto ch: children) {
+            result->addChild(ch->object);
+            ch->object->setParent(result);
+        }
+
+        /* Activate / configure the object */
+        result->activate();
+        return result;
+    };
+
+    /* Declared after everything the loading tasks refer to, so that it is
+       destroyed (which waits for pending tasks) before any of it */
+    tbb::task_group loaders;
+
+    /* Helper function: wait for background loads and forward the first error */
+    auto join = [&](const std::vector<ParsedObject *> &list) {
+        bool deferred = false;
+        for (auto obj : list)
+            deferred |= obj->deferred;
+        if (!deferred)
+            return;
+        loaders.wait();
+        for (auto obj : list)
+            if (obj->error)
+                std::rethrow_exception(obj->error);
+    };
+
     /* Helper function to parse a Nori XML node (recursive) */
-    std::function<NoriObject *(pugi::xml_node &, PropertyList &, int)> parseTag = [&](
-        pugi::xml_node &node, PropertyList &list, int parentTag) -> NoriObject * {
+    std::function<ParsedObject *(pugi::xml_node &, PropertyList &, int)> parseTag = [&](
+        pugi::xml_node &node, PropertyList &list, int parentTag) -> ParsedObject * {
         /* Skip over comments */
         if (node.type() == pugi::node_comment || node.type() == pugi::node_declaration)
             return nullptr;
@@ -162,41 +228,40 @@ NoriObject *loadFromXML(const std::string &filename) {
             transform.setIdentity();
 
         PropertyList propList;
-        std::vector<NoriObject *> children;
+        std::vector<ParsedObject *> children;
         for (pugi::xml_node &ch: node.children()) {
-            NoriObject *child = parseTag(ch, propList, tag);
+            ParsedObject *child = parseTag(ch, propList, tag);
             if (child)
                 children.push_back(child);
         }
 
-        NoriObject *result = nullptr;
+        /* Children that are still loading must be complete before they can be added */
+        join(children);
+
+        ParsedObject *result = nullptr;
         try {
             if (currentIsObject) {
-                check_attributes(node, { "type" });
-
-                /* This is an object, first instantiate it */
-                result = NoriObjectFactory::createInstance(
-                    node.attribute("type").value(),
-                    propList
-                );
-
-                if (result->getClassType() != (int) tag) {
-                    throw NoriException(
-                        "Unexpectedly constructed an object "
-                        "of type <%s> (expected type <%s>): %s",
-                        NoriObject::classTypeName(result->getClassType()),
-                        NoriObject::classTypeName((NoriObject::EClassType) tag),
-                        result->toString());
-                }
-
-                /* Add all children */
-                for (auto ch: children) {
-                    result->addChild(ch);
-                    ch->setParent(result);
+                objects.emplace_back();
+                result = &objects.back();
+
+                if (tag == EMesh) {
+                    /* Load the mesh in the background */
+                    result->deferred = true;
+                    pugi::xml_node meshNode = node;
+                    loaders.run([=, &instantiate, &offset, &filename, propList = std::move(propList)] {
+                        try {
+                            result->object = instantiate(meshNode, tag, propList, children);
+                        } catch (const NoriException &e) {
+                            result->error = std::make_exception_ptr(NoriException(
+                                "Error while parsing \"%s\": %s (at %s)", filename,
+                                e.what(), offset(meshNode.offset_debug())));
+                        } catch (...) {
+                            result->error = std::current_exception();
+                        }
+                    });
+                } else {
+                    result->object = instantiate(node, tag, propList, children);
                 }
-
-                /* Activate / configure the object */
-                result->activate();
             } else {
                 /* This is a property */
                 switch (tag) {
@@ -277,15 +342,7 @@ NoriObject *loadFromXML(const std::string &filename) {
                             Eigen::Vector3f target = toVector3f(node.attribute("target").value());
                             Eigen::Vector3f up = toVector3f(node.attribute("up").value());
 
-                            Vector3f dir = (target - origin).normalized();
-                            Vector3f left = up.normalized().cross(dir).normalized();
-                            Vector3f newUp = dir.cross(left).normalized();
-
-                            Eigen::Matrix4f trafo;
-                            trafo << left, newUp, dir, origin,
-                                      0, 0, 0, 1;
-
-                            transform = Eigen::Affine3f(trafo) * transform;
+                            transform = Eigen::Affine3f(Transform::lookAt(origin, target, up).getMatrix()) * transform;
                         }
                         break;
 
@@ -301,7 +358,9 @@ NoriObject *loadFromXML(const std::string &filename) {
     };
 
     PropertyList list;
-    return parseTag(*doc.begin(), list, EInvalid);
+    ParsedObject *root = parseTag(*doc.begin(), list, EInvalid);
+    join({ root });
+    return root->object;
 }
 
 NORI_NAMESPACE_END
@@ -25,6 +25,13 @@ public:
         m_outputSize.y() = propList.getInteger("height", 720);
         m_invOutputSize = m_outputSize.cast<float>().cwiseInverse();
 
+        /* Optional crop window in pixels. Default: the entire image */
+        setCropWindow(
+            Point2i(propList.getInteger("cropOffsetX", 0),
+                    propList.getInteger("cropOffsetY", 0)),
+            Vector2i(propList.getInteger("cropWidth", m_outputSize.x()),
+                     propList.getInteger("cropHeight", m_outputSize.y())));
+
         /* Specifies an optional camera-to-world transformation. Default: none */
         m_cameraToWorld = propList.getTransform("toWorld", Transform());
 
@@ -38,7 +45,8 @@ public:
         m_rfilter = NULL;
     }
 
-    void activate() {
+    /// Recompute the sample-to-camera transformation (e.g. after a change of the field of view)
+    void updateProjection() {
         float aspect = m_outputSize.x() / (float) m_outputSize.y();
 
         /* Project vectors in camera space onto a plane at z=1:
@@ -66,6 +74,10 @@ public:
         m_sampleToCamera = Transform( 
             Eigen::DiagonalMatrix<float, 3>(Vector3f(-0.5f, -0.5f * aspect, 1.0f)) *
             Eigen::Translation<float, 3>(-1.0f, -1.0f/aspect, 0.0f) * perspective).inverse();
+    }
+
+    void activate() {
+        updateProjection();
 
         /* If no reconstruction filter was assigned, instantiate a Gaussian filter */
         if (!m_rfilter)
@@ -96,6 +108,17 @@ public:
         return Color3f(1.0f);
     }
 
+    Transform getCameraToWorld() const { return m_cameraToWorld; }
+
+    void setCameraToWorld(const Transform &trafo) { m_cameraToWorld = trafo; }
+
+    float getFov() const { return m_fov; }
+
+    void setFov(float fov) {
+        m_fov = fov;
+        updateProjection();
+    }
+
     void addChild(NoriObject *obj) {
         switch (obj->getClassType()) {
             case EReconstructionFilter:
@@ -116,12 +139,15 @@ public:
             "PerspectiveCamera[\n"
             "  cameraToWorld = %s,\n"
             "  outputSize = %s,\n"
+            "  crop = [%s, %s],\n"
             "  fov = %f,\n"
             "  clip = [%f, %f],\n"
             "  rfilter = %s\n"
             "]",
             indent(m_cameraToWorld.toString(), 18),
             m_outputSize.toString(),
+            m_cropOffset.toString(),
+            m_cropSize.toString(),
             m_fov,
             m_nearClip,
             m_farClip,
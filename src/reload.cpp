@@ -0,0 +1,187 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#include <nori/reload.h>
+#include <nori/parser.h>
+#include <nori/scene.h>
+#include <nori/camera.h>
+#include <nori/block.h>
+#include <pugixml.hpp>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+
+NORI_NAMESPACE_BEGIN
+
+/* Return the child elements of a node (skipping e.g. comments) */
+static std::vector<pugi::xml_node> elements(const pugi::xml_node &node) {
+    std::vector<pugi::xml_node> result;
+    for (pugi::xml_node child : node.children())
+        if (child.type() == pugi::node_element)
+            result.push_back(child);
+    return result;
+}
+
+/* Serialize a node, which is also used to compare two of them */
+static std::string serialize(const pugi::xml_node &node) {
+    std::ostringstream os;
+    node.print(os, "", pugi::format_raw);
+    return os.str();
+}
+
+/* Serialize a mesh without its BSDF and emitter */
+static std::string serializeGeometry(const pugi::xml_node &node) {
+    pugi::xml_document doc;
+    pugi::xml_node copy = doc.append_copy(node);
+    for (const char *name : { "bsdf", "emitter" })
+        while (copy.child(name))
+            copy.remove_child(copy.child(name));
+    return serialize(copy);
+}
+
+/* The image that is being rendered can't change its size, or the border
+   that the reconstruction filter needs (see ImageBlock::put(ImageBlock&)) */
+static void checkCamera(const Camera *camera, const Camera *newCamera) {
+    if (newCamera->getOutputSize() != camera->getOutputSize())
+        throw NoriException("Changing the output size requires a restart");
+    if (ImageBlock(Vector2i(0, 0), newCamera->getReconstructionFilter()).getBorderSize() !=
+        ImageBlock(Vector2i(0, 0), camera->getReconstructionFilter()).getBorderSize())
+        throw NoriException("Changing the radius of the reconstruction filter requires a restart");
+}
+
+SceneReloader::SceneReloader(const std::string &filename)
+        : m_filename(filename), m_doc(new pugi::xml_document()) {
+    m_contents = m_polled = read();
+    pugi::xml_parse_result result = m_doc->load_buffer(m_contents.data(), m_contents.size());
+    if (!result)
+        throw NoriException("Error while parsing \"%s\": %s", m_filename, result.description());
+}
+
+SceneReloader::~SceneReloader() { }
+
+std::string SceneReloader::read() const {
+    std::ifstream is(m_filename, std::ios::binary);
+    if (!is.good())
+        throw NoriException("Could not open \"%s\"", m_filename);
+    return std::string((std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
+}
+
+bool SceneReloader::poll() {
+    /* Scene files are small, so simply compare the contents. This also
+       catches edits that don't change the modification time. */
+    std::string contents;
+    try {
+        contents = read();
+    } catch (const NoriException &) {
+        /* The file may briefly disappear while an editor saves it */
+        return false;
+    }
+    if (contents == m_polled)
+        return false;
+    m_polled = contents;
+    return true;
+}
+
+SceneReloader::EChange SceneReloader::reload(std::unique_ptr<NoriObject> &root) {
+    if (root->getClassType() != NoriObject::EScene)
+        throw NoriException("SceneReloader: the root object is not a scene");
+    Scene *scene = static_cast<Scene *>(root.get());
+
+    std::string contents = read();
+    std::unique_ptr<pugi::xml_document> doc(new pugi::xml_document());
+    pugi::xml_parse_result result = doc->load_buffer(contents.data(), contents.size());
+    if (!result)
+        throw NoriException("Error while parsing \"%s\": %s", m_filename, result.description());
+
+    /* Compare the top-level elements, and collect the objects that need to
+       be replaced along with their new definitions */
+    std::vector<pugi::xml_node> oldChildren = elements(m_doc->document_element()),
+                                newChildren = elements(doc->document_element());
+    std::vector<std::pair<NoriObject *, pugi::xml_node>> replacements;
+    EChange change = ENone;
+    bool complete = strcmp(m_doc->document_element().name(), doc->document_element().name()) != 0 ||
+                    oldChildren.size() != newChildren.size();
+    size_t meshIndex = 0, emitterIndex = 0;
+
+    for (size_t i=0; i<oldChildren.size() && !complete; ++i) {
+        const pugi::xml_node &a = oldChildren[i], &b = newChildren[i];
+        std::string name = a.name();
+        if (name != b.name()) {
+            complete = true;
+            break;
+        }
+
+        /* Meshes with an emitter are kept in a separate list */
+        Mesh *mesh = nullptr;
+        if (name == "mesh") {
+            bool emitter = a.child("emitter");
+            const std::vector<Mesh *> &meshes = emitter ? scene->getEmitters() : scene->getMeshes();
+            size_t &index = emitter ? emitterIndex : meshIndex;
+            if (index >= meshes.size()) {
+                complete = true;
+                break;
+            }
+            mesh = meshes[index++];
+        }
+
+        if (serialize(a) == serialize(b))
+            continue;
+
+        if (name == "camera" || name == "integrator" || name == "sampler") {
+            replacements.emplace_back(scene, b);
+            change = std::max(change, name == "camera" ? ECamera : EShading);
+        } else if (mesh && serializeGeometry(a) == serializeGeometry(b)) {
+            for (const char *childName : { "bsdf", "emitter" }) {
+                pugi::xml_node ca = a.child(childName), cb = b.child(childName);
+                if (!ca != !cb)
+                    complete = true;
+                else if (ca && serialize(ca) != serialize(cb))
+                    replacements.emplace_back(mesh, cb);
+            }
+            change = std::max(change, EShading);
+        } else {
+            complete = true;
+        }
+    }
+
+    if (complete) {
+        /* Start over, but keep the old scene if anything goes wrong */
+        std::unique_ptr<NoriObject> newRoot(loadFromXMLString(contents, m_filename));
+        if (newRoot->getClassType() != NoriObject::EScene)
+            throw NoriException("SceneReloader: the root object is not a scene");
+        checkCamera(scene->getCamera(), static_cast<Scene *>(newRoot.get())->getCamera());
+        root = std::move(newRoot);
+        change = EScene;
+    } else {
+        /* Instantiate all new objects before anything is replaced */
+        std::vector<std::unique_ptr<NoriObject>> objects;
+        for (auto &replacement : replacements) {
+            objects.emplace_back(loadFromXMLString(serialize(replacement.second), m_filename));
+            const NoriObject *object = objects.back().get();
+            if (object->getClassType() == NoriObject::ECamera)
+                checkCamera(scene->getCamera(), static_cast<const Camera *>(object));
+        }
+
+        for (size_t i=0; i<replacements.size(); ++i) {
+            NoriObject *target = replacements[i].first, *object = objects[i].release();
+            if (target == scene)
+                scene->replaceChild(object);
+            else
+                static_cast<Mesh *>(target)->replaceChild(object);
+        }
+    }
+
+    m_contents = contents;
+    m_doc = std::move(doc);
+    return change;
+}
+
+std::string SceneReloader::toString() const {
+    return tfm::format("SceneReloader[filename=\"%s\"]", m_filename);
+}
+
+NORI_NAMESPACE_END
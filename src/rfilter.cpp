@@ -8,6 +8,31 @@
 
 NORI_NAMESPACE_BEGIN
 
+FilterSampler::FilterSampler(const ReconstructionFilter *filter)
+        : m_pdf(NORI_FILTER_SAMPLING_RESOLUTION), m_radius(filter->getRadius()) {
+    m_binSize = 2 * m_radius / NORI_FILTER_SAMPLING_RESOLUTION;
+
+    /* Tabulate the filter at the center of every bin */
+    std::vector<float> values(NORI_FILTER_SAMPLING_RESOLUTION);
+    for (int i=0; i<NORI_FILTER_SAMPLING_RESOLUTION; ++i) {
+        values[i] = filter->eval((i + 0.5f) * m_binSize - m_radius);
+        m_pdf.append(std::abs(values[i]));
+    }
+    float integral = m_pdf.normalize() * m_binSize;
+    if (integral <= 0)
+        throw NoriException("FilterSampler: %s can't be sampled", filter->toString());
+
+    /* f(x) / p(x) of the tabulated filter, i.e. +/- its absolute integral */
+    m_weights.resize(NORI_FILTER_SAMPLING_RESOLUTION);
+    for (int i=0; i<NORI_FILTER_SAMPLING_RESOLUTION; ++i)
+        m_weights[i] = values[i] < 0 ? -integral : integral;
+}
+
+std::string FilterSampler::toString() const {
+    return tfm::format("FilterSampler[radius=%f, resolution=%i]",
+                       m_radius, NORI_FILTER_SAMPLING_RESOLUTION);
+}
+
 /**
  * Windowed Gaussian filter with configurable extent
  * and standard deviation. Often produces pleasing 
@@ -84,6 +84,30 @@ void Scene::addChild(NoriObject *obj) {
     }
 }
 
+void Scene::replaceChild(NoriObject *obj) {
+    switch (obj->getClassType()) {
+        case ESampler:
+            delete m_sampler;
+            m_sampler = static_cast<Sampler *>(obj);
+            break;
+
+        case ECamera:
+            delete m_camera;
+            m_camera = static_cast<Camera *>(obj);
+            break;
+
+        case EIntegrator:
+            delete m_integrator;
+            m_integrator = static_cast<Integrator *>(obj);
+            break;
+
+        default:
+            throw NoriException("Scene::replaceChild(<%s>) is not supported!",
+                classTypeName(obj->getClassType()));
+    }
+    obj->setParent(this);
+}
+
 std::string Scene::toString() const {
     std::string meshes;
     for (size_t i=0; i<m_meshes.size(); ++i) {
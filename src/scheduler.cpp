@@ -0,0 +1,175 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#include <nori/scheduler.h>
+#include <algorithm>
+
+NORI_NAMESPACE_BEGIN
+
+TileScheduler::TileScheduler(const Vector2i &size, int blockSize, int workerCount,
+                             const Point2i &offset)
+        : m_size(size), m_blockSize(blockSize), m_workerCount(workerCount),
+          m_next(0), m_pieceCount(0), m_start(Clock::now()) {
+    /* Enumerate the tiles in the order of the block generator */
+    BlockGenerator blockGenerator(size, blockSize, offset);
+    m_tileCount = blockGenerator.getBlockCount();
+    m_tiles.reset(new Tile[m_tileCount]);
+    for (int i=0; i<m_tileCount; ++i) {
+        blockGenerator.next(m_tiles[i].offset, m_tiles[i].size);
+        m_tiles[i].currentCost = 0;
+        m_order.push_back(i);
+    }
+
+    /* Every steal takes at least one row, which bounds the number of pieces */
+    int tilesPerRow = (size.x() + blockSize - 1) / blockSize;
+    m_pieceCapacity = m_tileCount + tilesPerRow * size.y();
+    m_pieces.reset(new Piece[m_pieceCapacity]);
+
+    m_workers.resize(workerCount);
+    reset();
+}
+
+void TileScheduler::reset() {
+    if (m_passes > 0) {
+        /* Start with the tiles that were the most expensive ones last time */
+        for (int i=0; i<m_tileCount; ++i)
+            m_tiles[i].cost = m_tiles[i].currentCost.exchange(0);
+        std::stable_sort(m_order.begin(), m_order.end(), [&](int a, int b) {
+            return m_tiles[a].cost > m_tiles[b].cost;
+        });
+    }
+
+    for (int i=0; i<m_pieceCapacity; ++i) {
+        Piece &piece = m_pieces[i];
+        if (i < m_tileCount) {
+            piece.tile = m_order[i];
+            piece.begin = 0;
+            piece.rows = pack(0, (uint32_t) m_tiles[piece.tile].size.y());
+        } else {
+            piece.rows = pack(0, 0);
+        }
+    }
+
+    m_next = 0;
+    m_pieceCount = m_tileCount;
+    m_passes++;
+}
+
+int TileScheduler::next(int worker, ImageBlock &block) {
+    m_workers[worker].start = now();
+
+    int index = m_next.fetch_add(1);
+    if (index >= m_tileCount)
+        return steal(block);
+
+    const Tile &tile = m_tiles[m_pieces[index].tile];
+    block.setOffset(tile.offset);
+    block.setSize(tile.size);
+    return index;
+}
+
+bool TileScheduler::nextRow(int index, int &row) {
+    Piece &piece = m_pieces[index];
+    uint64_t rows = piece.rows.load();
+    while (true) {
+        uint32_t next = (uint32_t) (rows >> 32), end = (uint32_t) rows;
+        if (next >= end)
+            return false;
+        if (piece.rows.compare_exchange_weak(rows, pack(next + 1, end))) {
+            row = (int) next - piece.begin;
+            return true;
+        }
+    }
+}
+
+void TileScheduler::skip(int index) {
+    m_pieces[index].rows = pack(0, 0);
+}
+
+void TileScheduler::done(int worker, int index) {
+    Worker &w = m_workers[worker];
+    int64_t end = now();
+    w.busy.push_back(std::make_pair(w.start, end));
+    m_tiles[m_pieces[index].tile].currentCost += end - w.start;
+}
+
+int TileScheduler::steal(ImageBlock &block) {
+    while (true) {
+        /* Find the piece with the most remaining rows */
+        int pieceCount = m_pieceCount.load(), victim = -1;
+        uint32_t mostRows = 1;
+        for (int i=0; i<pieceCount; ++i) {
+            uint64_t rows = m_pieces[i].rows.load(std::memory_order_relaxed);
+            uint32_t next = (uint32_t) (rows >> 32), end = (uint32_t) rows;
+            if (end > next && end - next > mostRows) {
+                mostRows = end - next;
+                victim = i;
+            }
+        }
+
+        /* Nothing left that could be split */
+        if (victim < 0)
+            return -1;
+
+        /* Leave the first half to the current owner, take the second one */
+        Piece &piece = m_pieces[victim];
+        uint64_t rows = piece.rows.load();
+        uint32_t next = (uint32_t) (rows >> 32), end = (uint32_t) rows;
+        if (end <= next || end - next < 2)
+            continue;
+        uint32_t mid = next + (end - next) / 2;
+        if (!piece.rows.compare_exchange_strong(rows, pack(next, mid)))
+            continue;
+
+        int index = m_pieceCount.fetch_add(1);
+        Piece &stolen = m_pieces[index];
+        stolen.tile = piece.tile;
+        stolen.begin = (int) mid;
+        stolen.rows = pack(mid, end);
+
+        /* Render the stolen rows into a block that starts at the first one */
+        const Tile &tile = m_tiles[stolen.tile];
+        block.setOffset(Point2i(tile.offset.x(), tile.offset.y() + (int) mid));
+        block.setSize(Vector2i(tile.size.x(), tile.size.y() - (int) mid));
+        return index;
+    }
+}
+
+int64_t TileScheduler::now() const {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        Clock::now() - m_start).count();
+}
+
+std::string TileScheduler::getUtilization(int slices) const {
+    int64_t total = std::max(now(), (int64_t) 1);
+    std::vector<double> busy(slices, 0.0);
+    double sliceLength = (double) total / slices;
+
+    for (const Worker &w : m_workers) {
+        for (auto interval : w.busy) {
+            for (int i=0; i<slices; ++i) {
+                double begin = std::max((double) interval.first, i * sliceLength);
+                double end = std::min((double) interval.second, (i + 1) * sliceLength);
+                if (end > begin)
+                    busy[i] += end - begin;
+            }
+        }
+    }
+
+    std::string result = "Core utilization over time:";
+    for (int i=0; i<slices; ++i)
+        result += tfm::format(" %i%%", (int) std::round(
+            100.0 * busy[i] / (sliceLength * m_workerCount)));
+    result += tfm::format(" (%i intervals of %s)", slices, timeString(sliceLength / 1000.0, true));
+    return result;
+}
+
+std::string TileScheduler::toString() const {
+    return tfm::format("TileScheduler[tiles=%i, blockSize=%i, workers=%i]",
+        m_tileCount, m_blockSize, m_workerCount);
+}
+
+NORI_NAMESPACE_END
@@ -0,0 +1,101 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#include <nori/sampler.h>
+#include <nori/qmc.h>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Owen-scrambled Sobol sampler
+ *
+ * The first two dimensions of the Sobol sequence form a (0, 2)-sequence:
+ * for every power of two N, the first N points stratify the unit square
+ * into all N elementary intervals (1xN, 2xN/2, ..., Nx1 cells) at once.
+ * Integrands that are smooth, or have edges, then converge considerably
+ * faster than with independent samples.
+ *
+ * Each \ref next1D() or \ref next2D() call uses a fresh copy of this 2D
+ * sequence ("padding"), which is decorrelated from the others by
+ *
+ * - shuffling the order of the points (an Owen scramble of the sample
+ *   index, which keeps the stratification of every power-of-two prefix)
+ * - and Owen scrambling the coordinates,
+ *
+ * both seeded by a hash of the pixel and the dimension. Every pixel thus
+ * receives an independent randomization, and no tables are needed, so
+ * arbitrarily many dimensions are available.
+ *
+ * Sample counts (and the number of samples per progressive pass) should
+ * be powers of two.
+ */
+class Sobol : public Sampler {
+public:
+    Sobol(const PropertyList &propList) {
+        m_sampleCount = (size_t) propList.getInteger("sampleCount", 1);
+        m_seed = (uint32_t) propList.getInteger("seed", 0);
+    }
+
+    virtual ~Sobol() { }
+
+    std::unique_ptr<Sampler> clone() const {
+        std::unique_ptr<Sobol> cloned(new Sobol());
+        cloned->m_sampleCount = m_sampleCount;
+        cloned->m_sampleOffset = m_sampleOffset;
+        cloned->m_seed = m_seed;
+        cloned->m_pixelSeed = m_pixelSeed;
+        cloned->m_sampleIndex = m_sampleIndex;
+        cloned->m_dimension = m_dimension;
+        return std::move(cloned);
+    }
+
+    void prepare(const ImageBlock &) {
+        /* The samples only depend on the pixel (see generate()) */
+        m_sampleIndex = (uint32_t) m_sampleOffset;
+        m_dimension = 0;
+    }
+
+    void generate(const Point2i &pixel) {
+        m_pixelSeed = qmc::hash(qmc::hash(m_seed, (uint32_t) pixel.x()), (uint32_t) pixel.y());
+        m_sampleIndex = (uint32_t) m_sampleOffset;
+        m_dimension = 0;
+    }
+
+    void advance() {
+        ++m_sampleIndex;
+        m_dimension = 0;
+    }
+
+    float next1D() {
+        uint32_t seed = qmc::hash(m_pixelSeed, m_dimension++);
+        uint32_t index = qmc::owenScramble(m_sampleIndex, seed);
+        return qmc::toFloat(qmc::owenScramble(qmc::sobol0(index), qmc::mix(seed)));
+    }
+
+    Point2f next2D() {
+        uint32_t seed = qmc::hash(m_pixelSeed, m_dimension++);
+        uint32_t index = qmc::owenScramble(m_sampleIndex, seed);
+        return Point2f(
+            qmc::toFloat(qmc::owenScramble(qmc::sobol0(index), qmc::hash(seed, 0))),
+            qmc::toFloat(qmc::owenScramble(qmc::sobol1(index), qmc::hash(seed, 1)))
+        );
+    }
+
+    std::string toString() const {
+        return tfm::format("Sobol[sampleCount=%i, seed=%i]", m_sampleCount, m_seed);
+    }
+protected:
+    Sobol() { }
+
+private:
+    uint32_t m_seed = 0;
+    uint32_t m_pixelSeed = 0;
+    uint32_t m_sampleIndex = 0;
+    uint32_t m_dimension = 0;
+};
+
+NORI_REGISTER_CLASS(Sobol, "sobol");
+NORI_NAMESPACE_END
@@ -0,0 +1,194 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#include <nori/streaming.h>
+#include <nori/rfilter.h>
+#include <ImfTiledOutputFile.h>
+#include <ImfChannelList.h>
+#include <ImfStringAttribute.h>
+#include <half.h>
+
+NORI_NAMESPACE_BEGIN
+
+struct StreamingOutput::File {
+    Imf::TiledOutputFile file;
+    std::vector<Color3f> buffer;
+    std::vector<half> halfBuffer;
+
+    File(const std::string &filename, const Imf::Header &header)
+        : file(filename.c_str(), header) { }
+};
+
+StreamingOutput::StreamingOutput(const std::string &filename, const Vector2i &imageSize,
+                                 const Point2i &offset, const Vector2i &size, int tileSize,
+                                 const ReconstructionFilter *filter, const EXROptions &options)
+        : m_offset(offset), m_size(size), m_tileSize(tileSize), m_half(options.half), m_written(0),
+          m_liveTiles(0), m_peakTiles(0) {
+    m_borderSize = filter ? (int) std::ceil(filter->getRadius() - 0.5f) : 0;
+    m_tileCount = Vector2i(
+        (size.x() + tileSize - 1) / tileSize,
+        (size.y() + tileSize - 1) / tileSize);
+
+    int tileCount = m_tileCount.x() * m_tileCount.y();
+    m_tiles.reset(new Tile[tileCount]);
+    for (int i=0; i<tileCount; ++i) {
+        Tile &tile = m_tiles[i];
+        Point2i pos(i % m_tileCount.x(), i / m_tileCount.x());
+        tile.offset = offset + pos * tileSize;
+        tile.size = (offset + size - tile.offset).cwiseMin(Vector2i::Constant(tileSize));
+        tile.rowsDone = 0;
+        tile.pending = 0;
+    }
+
+    /* A tile can be written once all tiles overlapping it are complete */
+    std::vector<int> overlapping;
+    for (int i=0; i<tileCount; ++i) {
+        neighbors(i, overlapping);
+        for (int j : overlapping)
+            m_tiles[j].pending++;
+    }
+
+    cout << "Streaming a " << size.x() << "x" << size.y()
+         << " tiled OpenEXR file to \"" << filename << "\"" << endl;
+
+    Imf::Header header(
+        Imath::Box2i(Imath::V2i(0, 0), Imath::V2i(imageSize.x() - 1, imageSize.y() - 1)),
+        Imath::Box2i(Imath::V2i(offset.x(), offset.y()),
+                     Imath::V2i(offset.x() + size.x() - 1, offset.y() + size.y() - 1)));
+    header.insert("comments", Imf::StringAttribute("Generated by Nori"));
+    header.compression() = (Imf::Compression) options.compression;
+    header.setTileDescription(Imf::TileDescription(tileSize, tileSize, Imf::ONE_LEVEL));
+
+    /* Tiles are finished in the order in which the spiral reaches them */
+    header.lineOrder() = Imf::RANDOM_Y;
+
+    Imf::PixelType type = m_half ? Imf::HALF : Imf::FLOAT;
+    Imf::ChannelList &channels = header.channels();
+    channels.insert("R", Imf::Channel(type));
+    channels.insert("G", Imf::Channel(type));
+    channels.insert("B", Imf::Channel(type));
+
+    m_file.reset(new File(filename, header));
+    m_file->buffer.resize(tileSize * tileSize);
+    if (m_half)
+        m_file->halfBuffer.resize(3 * tileSize * tileSize);
+}
+
+StreamingOutput::~StreamingOutput() {
+    int tileCount = m_tileCount.x() * m_tileCount.y();
+    if (m_written != tileCount)
+        cerr << "Warning: only " << m_written << " out of " << tileCount
+             << " tiles were written to the OpenEXR file!" << endl;
+}
+
+void StreamingOutput::neighbors(int index, std::vector<int> &result) const {
+    const Tile &tile = m_tiles[index];
+    Point2i min = (tile.offset - m_offset - Vector2i::Constant(m_borderSize))
+        .cwiseMax(Point2i(0, 0)) / m_tileSize;
+    Point2i max = (tile.offset - m_offset + tile.size + Vector2i::Constant(m_borderSize - 1))
+        .cwiseMin(m_size - Vector2i(1, 1)) / m_tileSize;
+
+    result.clear();
+    for (int y=min.y(); y<=max.y(); ++y)
+        for (int x=min.x(); x<=max.x(); ++x)
+            result.push_back(y * m_tileCount.x() + x);
+}
+
+void StreamingOutput::put(const ImageBlock &block, int rows) {
+    /* Stolen blocks start inside of their tile, but never leave it */
+    Point2i pos = (block.getOffset() - m_offset) / m_tileSize;
+    int index = pos.y() * m_tileCount.x() + pos.x();
+    int border = block.getBorderSize();
+
+    /* Region covered by the block, including its border */
+    Point2i blockMin = block.getOffset() - Vector2i::Constant(border);
+    Point2i blockMax = block.getOffset() + block.getSize() + Vector2i::Constant(border);
+
+    std::vector<int> overlapping;
+    neighbors(index, overlapping);
+
+    for (int i : overlapping) {
+        Tile &tile = m_tiles[i];
+        Point2i min = blockMin.cwiseMax(tile.offset);
+        Point2i max = blockMax.cwiseMin(tile.offset + tile.size);
+        if ((min.array() >= max.array()).any())
+            continue;
+
+        tbb::spin_mutex::scoped_lock lock(tile.mutex);
+        if (!tile.pixels) {
+            tile.pixels.reset(new Color4f[m_tileSize * m_tileSize]);
+            for (int j=0; j<m_tileSize * m_tileSize; ++j)
+                tile.pixels[j] = Color4f();
+            int live = ++m_liveTiles, peak = m_peakTiles;
+            while (live > peak && !m_peakTiles.compare_exchange_weak(peak, live))
+                ;
+        }
+
+        for (int y=min.y(); y<max.y(); ++y)
+            for (int x=min.x(); x<max.x(); ++x)
+                tile.pixels[(y - tile.offset.y()) * m_tileSize + (x - tile.offset.x())] +=
+                    block.coeff(y - blockMin.y(), x - blockMin.x());
+    }
+
+    /* Once the tile is complete, its neighbors have received all of its
+       contributions, and those that don't wait for anything else can be
+       written */
+    Tile &tile = m_tiles[index];
+    if (tile.rowsDone.fetch_add(rows) + rows != tile.size.y())
+        return;
+
+    for (int i : overlapping)
+        if (m_tiles[i].pending.fetch_sub(1) == 1)
+            write(i);
+}
+
+void StreamingOutput::write(int index) {
+    Tile &tile = m_tiles[index];
+    tbb::mutex::scoped_lock lock(m_fileMutex);
+    std::vector<Color3f> &buffer = m_file->buffer;
+
+    for (int y=0; y<tile.size.y(); ++y)
+        for (int x=0; x<tile.size.x(); ++x)
+            buffer[y * m_tileSize + x] = tile.pixels ?
+                tile.pixels[y * m_tileSize + x].divideByFilterWeight() : Color3f(0.f);
+
+    char *data = reinterpret_cast<char *>(buffer.data());
+    if (m_half) {
+        const float *src = reinterpret_cast<const float *>(buffer.data());
+        for (size_t i=0; i<m_file->halfBuffer.size(); ++i)
+            m_file->halfBuffer[i] = half(src[i]);
+        data = reinterpret_cast<char *>(m_file->halfBuffer.data());
+    }
+
+    /* Slices are addressed relative to the origin of the display window */
+    Imf::PixelType type = m_half ? Imf::HALF : Imf::FLOAT;
+    size_t compStride = m_half ? sizeof(half) : sizeof(float),
+           pixelStride = 3 * compStride,
+           rowStride = pixelStride * m_tileSize;
+    char *ptr = data - tile.offset.x() * pixelStride - tile.offset.y() * rowStride;
+
+    Imf::FrameBuffer frameBuffer;
+    frameBuffer.insert("R", Imf::Slice(type, ptr, pixelStride, rowStride)); ptr += compStride;
+    frameBuffer.insert("G", Imf::Slice(type, ptr, pixelStride, rowStride)); ptr += compStride;
+    frameBuffer.insert("B", Imf::Slice(type, ptr, pixelStride, rowStride));
+
+    Point2i pos = (tile.offset - m_offset) / m_tileSize;
+    m_file->file.setFrameBuffer(frameBuffer);
+    m_file->file.writeTile(pos.x(), pos.y());
+
+    if (tile.pixels) {
+        tile.pixels.reset();
+        --m_liveTiles;
+    }
+    ++m_written;
+}
+
+std::string StreamingOutput::toString() const {
+    return tfm::format("StreamingOutput[size=%s, tileSize=%i, written=%i, peakTiles=%i]",
+                       m_size.toString(), m_tileSize, (int) m_written, (int) m_peakTiles);
+}
+
+NORI_NAMESPACE_END
@@ -0,0 +1,200 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#include <nori/tev.h>
+#include <cstring>
+
+#if defined(_WIN32)
+#  include <winsock2.h>
+#  include <ws2tcpip.h>
+#  define NORI_CLOSE_SOCKET closesocket
+#else
+#  include <sys/types.h>
+#  include <sys/socket.h>
+#  include <netinet/in.h>
+#  include <netinet/tcp.h>
+#  include <netdb.h>
+#  include <unistd.h>
+#  define NORI_CLOSE_SOCKET close
+#endif
+
+#if defined(MSG_NOSIGNAL)
+#  define NORI_SEND_FLAGS MSG_NOSIGNAL /* Report a closed connection as an error instead of raising SIGPIPE */
+#else
+#  define NORI_SEND_FLAGS 0
+#endif
+
+NORI_NAMESPACE_BEGIN
+
+/* Packet types of tev's IPC protocol */
+enum ETevPacket : uint8_t {
+    ETevCreateImage = 4,
+    ETevUpdateImage = 5
+};
+
+/* Every packet starts with its total length (including the length itself)
+   and its type, followed by little-endian values and null-terminated strings */
+static void beginPacket(std::vector<char> &packet, ETevPacket type) {
+    packet.assign(sizeof(uint32_t), 0);
+    packet.push_back((char) type);
+}
+
+template <typename T> static void append(std::vector<char> &packet, T value) {
+    const char *ptr = (const char *) &value;
+    packet.insert(packet.end(), ptr, ptr + sizeof(T));
+}
+
+static void append(std::vector<char> &packet, const std::string &value) {
+    packet.insert(packet.end(), value.c_str(), value.c_str() + value.size() + 1);
+}
+
+TevClient::TevClient(const std::string &address, const std::string &name,
+                     const ImageBlock &block, float interval)
+        : m_address(address), m_name(name), m_block(block), m_interval(interval) {
+    size_t colon = address.rfind(':');
+    if (colon == std::string::npos)
+        throw NoriException("TevClient: expected an address of the form host:port, got \"%s\"", address);
+    std::string host = address.substr(0, colon), port = address.substr(colon + 1);
+
+#if defined(_WIN32)
+    WSADATA wsaData;
+    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
+        throw NoriException("TevClient: could not initialize Winsock");
+#endif
+
+    struct addrinfo hints, *addresses = nullptr;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &addresses) != 0)
+        throw NoriException("TevClient: could not resolve \"%s\"", address);
+
+    for (struct addrinfo *ai = addresses; ai; ai = ai->ai_next) {
+        int s = (int) socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (s < 0)
+            continue;
+        if (connect(s, ai->ai_addr, (int) ai->ai_addrlen) == 0) {
+            m_socket = s;
+            break;
+        }
+        NORI_CLOSE_SOCKET(s);
+    }
+    freeaddrinfo(addresses);
+
+    if (m_socket < 0)
+        throw NoriException("TevClient: could not connect to tev at \"%s\"", address);
+    m_connected = true;
+
+#if defined(SO_NOSIGPIPE)
+    int one = 1;
+    setsockopt(m_socket, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+
+    /* Create an image of the block's size with R, G and B channels */
+    beginPacket(m_packet, ETevCreateImage);
+    append(m_packet, (uint8_t) 1);    /* Grab focus */
+    append(m_packet, m_name);
+    append(m_packet, (int32_t) block.getSize().x());
+    append(m_packet, (int32_t) block.getSize().y());
+    append(m_packet, (int32_t) 3);
+    for (const char *channel : { "R", "G", "B" })
+        append(m_packet, std::string(channel));
+    m_connected = send(m_packet);
+
+    m_thread = std::thread([this] { run(); });
+}
+
+TevClient::~TevClient() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_cond.notify_one();
+    m_thread.join();
+
+    /* The render is complete, send everything that is still missing */
+    if (m_connected)
+        sendChanges();
+
+    NORI_CLOSE_SOCKET(m_socket);
+#if defined(_WIN32)
+    WSACleanup();
+#endif
+}
+
+void TevClient::run() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_stop && m_connected) {
+        m_cond.wait_for(lock, std::chrono::duration<float>(m_interval));
+        if (m_stop)
+            break;
+        lock.unlock();
+        m_connected = sendChanges();
+        lock.lock();
+    }
+}
+
+bool TevClient::sendChanges() {
+    m_block.snapshotChanges(m_snapshot, m_changed);
+
+    int border = m_block.getBorderSize();
+    BoundingBox2i interior(Point2i(border, border),
+                           Point2i(border + m_block.getSize().x() - 1,
+                                   border + m_block.getSize().y() - 1));
+
+    for (BoundingBox2i region : m_changed) {
+        /* The border isn't part of the image */
+        region.clip(interior);
+        if (!region.isValid())
+            continue;
+        Vector2i size = region.getExtents() + Vector2i(1, 1);
+
+        beginPacket(m_packet, ETevUpdateImage);
+        append(m_packet, (uint8_t) 0);    /* Grab focus */
+        append(m_packet, m_name);
+        append(m_packet, (int32_t) 3);
+        for (const char *channel : { "R", "G", "B" })
+            append(m_packet, std::string(channel));
+        append(m_packet, (int32_t) (region.min.x() - border));
+        append(m_packet, (int32_t) (region.min.y() - border));
+        append(m_packet, (int32_t) size.x());
+        append(m_packet, (int32_t) size.y());
+
+        /* Normalized pixel values, one channel after the other */
+        for (int channel = 0; channel < 3; ++channel)
+            for (int y=region.min.y(); y<=region.max.y(); ++y)
+                for (int x=region.min.x(); x<=region.max.x(); ++x)
+                    append(m_packet, m_snapshot.coeff(y, x).divideByFilterWeight()[channel]);
+
+        if (!send(m_packet))
+            return false;
+    }
+    return true;
+}
+
+bool TevClient::send(std::vector<char> &packet) {
+    uint32_t length = (uint32_t) packet.size();
+    memcpy(packet.data(), &length, sizeof(uint32_t));
+
+    size_t sent = 0;
+    while (sent < packet.size()) {
+        auto result = ::send(m_socket, packet.data() + sent, (int) (packet.size() - sent), NORI_SEND_FLAGS);
+        if (result <= 0) {
+            cerr << "Warning: lost the connection to tev at \"" << m_address
+                 << "\", no further updates will be sent" << endl;
+            return false;
+        }
+        sent += (size_t) result;
+    }
+    return true;
+}
+
+std::string TevClient::toString() const {
+    return tfm::format("TevClient[address=\"%s\", name=\"%s\", interval=%f]",
+                       m_address, m_name, m_interval);
+}
+
+NORI_NAMESPACE_END
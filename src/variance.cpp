@@ -0,0 +1,85 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#include <nori/variance.h>
+#include <nori/bitmap.h>
+#include <iostream>
+
+NORI_NAMESPACE_BEGIN
+
+VarianceBuffer::VarianceBuffer(const Vector2i &size, const Point2i &offset)
+        : m_size(size), m_offset(offset) {
+    clear();
+}
+
+void VarianceBuffer::clear() {
+    size_t count = (size_t) m_size.x() * (size_t) m_size.y();
+    m_pixels.assign(count, Pixel());
+    m_active.assign(count, 1);
+}
+
+float VarianceBuffer::getRelativeError(const Point2i &pixel) const {
+    const Pixel &p = m_pixels[index(pixel)];
+    if (p.count < 2)
+        return std::numeric_limits<float>::infinity();
+
+    /* Standard error of the mean, relative to the mean. The small
+       constant keeps (nearly) black pixels from never converging. */
+    float variance = p.m2 / (p.count - 1);
+    return std::sqrt(variance / p.count) / (p.mean + 1e-2f);
+}
+
+bool VarianceBuffer::isActive(const ImageBlock &block) const {
+    Point2i offset = block.getOffset();
+    Vector2i size = block.getSize();
+    for (int y=0; y<size.y(); ++y)
+        for (int x=0; x<size.x(); ++x)
+            if (isActive(Point2i(x + offset.x(), y + offset.y())))
+                return true;
+    return false;
+}
+
+size_t VarianceBuffer::update(float threshold, uint32_t minSamples, uint32_t maxSamples) {
+    size_t active = 0;
+    for (int y=0; y<m_size.y(); ++y) {
+        for (int x=0; x<m_size.x(); ++x) {
+            Point2i pixel(x + m_offset.x(), y + m_offset.y());
+            uint32_t count = getSampleCount(pixel);
+            bool needsSamples = count < maxSamples &&
+                (count < minSamples || getRelativeError(pixel) > threshold);
+            m_active[y * m_size.x() + x] = needsSamples ? 1 : 0;
+            if (needsSamples)
+                ++active;
+        }
+    }
+    return active;
+}
+
+void VarianceBuffer::write(std::ostream &os) const {
+    os.write((const char *) m_pixels.data(), sizeof(Pixel) * m_pixels.size());
+    os.write((const char *) m_active.data(), m_active.size());
+}
+
+void VarianceBuffer::read(std::istream &is) {
+    is.read((char *) m_pixels.data(), sizeof(Pixel) * m_pixels.size());
+    is.read((char *) m_active.data(), m_active.size());
+}
+
+Bitmap *VarianceBuffer::toBitmap() const {
+    Bitmap *result = new Bitmap(m_size);
+    for (int y=0; y<m_size.y(); ++y)
+        for (int x=0; x<m_size.x(); ++x)
+            result->coeffRef(y, x) = Color3f((float) getSampleCount(
+                Point2i(x + m_offset.x(), y + m_offset.y())));
+    return result;
+}
+
+std::string VarianceBuffer::toString() const {
+    return tfm::format("VarianceBuffer[offset=%s, size=%s]",
+                       m_offset.toString(), m_size.toString());
+}
+
+NORI_NAMESPACE_END
@@ -0,0 +1,226 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+*/
+
+#include <nori/wavefront.h>
+#include <nori/variance.h>
+#include <nori/sampler.h>
+#include <nori/camera.h>
+#include <nori/scene.h>
+#include <nori/block.h>
+#include <nori/accel.h>
+#include <nori/rfilter.h>
+
+NORI_NAMESPACE_BEGIN
+
+void WavefrontRenderer::RayQueue::clear() {
+    ox.clear(); oy.clear(); oz.clear();
+    dx.clear(); dy.clear(); dz.clear();
+    mint.clear(); maxt.clear();
+    path.clear();
+}
+
+void WavefrontRenderer::RayQueue::push(const Ray3f &ray, uint32_t index) {
+    ox.push_back(ray.o.x()); oy.push_back(ray.o.y()); oz.push_back(ray.o.z());
+    dx.push_back(ray.d.x()); dy.push_back(ray.d.y()); dz.push_back(ray.d.z());
+    mint.push_back(ray.mint); maxt.push_back(ray.maxt);
+    path.push_back(index);
+}
+
+Ray3f WavefrontRenderer::RayQueue::get(size_t i) const {
+    return Ray3f(Point3f(ox[i], oy[i], oz[i]), Vector3f(dx[i], dy[i], dz[i]),
+                 mint[i], maxt[i]);
+}
+
+WavefrontRenderer::WavefrontRenderer(const Scene *scene, uint32_t interleave,
+                                     const FilterSampler *filterSampler)
+        : m_scene(scene), m_integrator(scene->getIntegrator()),
+          m_filterSampler(filterSampler), m_interleave(interleave) {
+    if (!m_integrator->supportsWavefront())
+        throw NoriException("The integrator does not support wavefront rendering: %s",
+                            m_integrator->toString());
+
+    /* Number the BSDFs, which serve as sort keys for the shading stage */
+    for (const Mesh *mesh : scene->getMeshes())
+        m_bsdfIndex.emplace(mesh->getBSDF(), (uint32_t) m_bsdfIndex.size());
+    m_keyOffset.resize(m_bsdfIndex.size() + 1);
+}
+
+void WavefrontRenderer::generate(Sampler *sampler, const Point2i &pixel, uint32_t sampleCount) {
+    const Camera *camera = m_scene->getCamera();
+
+    sampler->generate(pixel);
+    for (uint32_t i=0; i<sampleCount; ++i) {
+        Point2f pixelSample;
+        float weight = 1.f;
+        if (m_filterSampler)
+            pixelSample = Point2f(pixel.x() + 0.5f, pixel.y() + 0.5f)
+                + m_filterSampler->sample(sampler->next2D(), weight);
+        else
+            pixelSample = Point2f((float) pixel.x(), (float) pixel.y()) + sampler->next2D();
+        Point2f apertureSample = sampler->next2D();
+
+        /* Sample a ray from the camera */
+        Ray3f ray;
+        Color3f value = camera->sampleRay(ray, pixelSample, apertureSample);
+
+        uint32_t path = (uint32_t) m_pixelX.size();
+        m_pixelX.push_back(pixel.x());
+        m_pixelY.push_back(pixel.y());
+        m_sampleX.push_back(pixelSample.x());
+        m_sampleY.push_back(pixelSample.y());
+        m_weight.push_back(weight);
+        m_throughputR.push_back(value.r());
+        m_throughputG.push_back(value.g());
+        m_throughputB.push_back(value.b());
+        m_radianceR.push_back(0.f);
+        m_radianceG.push_back(0.f);
+        m_radianceB.push_back(0.f);
+        m_rays.push(ray, path);
+        sampler->advance();
+    }
+}
+
+void WavefrontRenderer::render(Sampler *sampler, ImageBlock &block, VarianceBuffer *variance) {
+    while (m_rays.size() > 0) {
+        intersect();
+        sort();
+        shade(sampler);
+        traceShadowRays();
+
+        /* Continue with the extension rays */
+        std::swap(m_rays, m_extensionRays);
+    }
+
+    /* Splat all samples into the image block (in batches, see ImageBlock::put()) */
+    Point2f batchPositions[NORI_SPLAT_BATCH];
+    Color3f batchValues[NORI_SPLAT_BATCH];
+    int batchSize = 0;
+    for (size_t i=0; i<m_pixelX.size(); ++i) {
+        Color3f value(m_radianceR[i], m_radianceG[i], m_radianceB[i]);
+        if (m_filterSampler) {
+            block.put(Point2i(m_pixelX[i], m_pixelY[i]), value, m_weight[i]);
+        } else {
+            batchPositions[batchSize] = Point2f(m_sampleX[i], m_sampleY[i]);
+            batchValues[batchSize++] = value;
+            if (batchSize == NORI_SPLAT_BATCH) {
+                block.put(batchSize, batchPositions, batchValues);
+                batchSize = 0;
+            }
+        }
+        if (variance)
+            variance->put(Point2i(m_pixelX[i], m_pixelY[i]), value);
+    }
+    block.put(batchSize, batchPositions, batchValues);
+
+    m_pixelX.clear(); m_pixelY.clear();
+    m_sampleX.clear(); m_sampleY.clear(); m_weight.clear();
+    m_throughputR.clear(); m_throughputG.clear(); m_throughputB.clear();
+    m_radianceR.clear(); m_radianceG.clear(); m_radianceB.clear();
+}
+
+void WavefrontRenderer::intersect() {
+    size_t rayCount = m_rays.size();
+    m_rayBuffer.resize(rayCount);
+    m_hits.resize(rayCount);
+    if (m_hitCapacity < rayCount) {
+        m_hitFlags.reset(new bool[rayCount]);
+        m_hitCapacity = rayCount;
+    }
+
+    for (size_t i=0; i<rayCount; ++i)
+        m_rayBuffer[i] = m_rays.get(i);
+    m_scene->getAccel()->rayIntersect((uint32_t) rayCount, m_rayBuffer.data(),
+                                      m_hits.data(), m_hitFlags.get(), false, m_interleave);
+
+    /* Rays that escaped the scene don't receive any radiance */
+    m_hitRay.clear();
+    for (size_t i=0; i<rayCount; ++i)
+        if (m_hitFlags[i])
+            m_hitRay.push_back((uint32_t) i);
+}
+
+void WavefrontRenderer::sort() {
+    size_t hitCount = m_hitRay.size();
+    m_hitKey.resize(hitCount);
+    m_order.resize(hitCount);
+    std::fill(m_keyOffset.begin(), m_keyOffset.end(), 0u);
+
+    /* Counting sort by BSDF */
+    for (size_t i=0; i<hitCount; ++i) {
+        auto it = m_bsdfIndex.find(m_hits[m_hitRay[i]].mesh->getBSDF());
+        uint32_t key = it != m_bsdfIndex.end() ? it->second : 0;
+        m_hitKey[i] = key;
+        m_keyOffset[key + 1]++;
+    }
+
+    for (size_t i=1; i<m_keyOffset.size(); ++i)
+        m_keyOffset[i] += m_keyOffset[i-1];
+
+    for (size_t i=0; i<hitCount; ++i)
+        m_order[m_keyOffset[m_hitKey[i]]++] = m_hitRay[i];
+}
+
+void WavefrontRenderer::shade(Sampler *sampler) {
+    m_extensionRays.clear();
+    m_shadowRays.clear();
+    m_shadowR.clear(); m_shadowG.clear(); m_shadowB.clear();
+
+    for (uint32_t rayIndex : m_order) {
+        uint32_t path = m_rays.path[rayIndex];
+
+        ShadingRecord sRec;
+        m_integrator->shade(m_scene, sampler, m_rayBuffer[rayIndex], m_hits[rayIndex], sRec);
+
+        Color3f throughput(m_throughputR[path], m_throughputG[path], m_throughputB[path]);
+
+        if (sRec.shadow) {
+            Color3f value = throughput * sRec.shadowValue;
+            m_shadowRays.push(sRec.shadowRay, path);
+            m_shadowR.push_back(value.r());
+            m_shadowG.push_back(value.g());
+            m_shadowB.push_back(value.b());
+        }
+
+        if (sRec.extend) {
+            throughput *= sRec.weight;
+            m_throughputR[path] = throughput.r();
+            m_throughputG[path] = throughput.g();
+            m_throughputB[path] = throughput.b();
+            m_extensionRays.push(sRec.ray, path);
+        }
+    }
+}
+
+void WavefrontRenderer::traceShadowRays() {
+    size_t rayCount = m_shadowRays.size();
+    m_rayBuffer.resize(rayCount);
+    if (m_hitCapacity < rayCount) {
+        m_hitFlags.reset(new bool[rayCount]);
+        m_hitCapacity = rayCount;
+    }
+
+    for (size_t i=0; i<rayCount; ++i)
+        m_rayBuffer[i] = m_shadowRays.get(i);
+    m_scene->getAccel()->rayIntersect((uint32_t) rayCount, m_rayBuffer.data(),
+                                      nullptr, m_hitFlags.get(), true, m_interleave);
+
+    /* Each path has at most one shadow ray per bounce */
+    for (size_t i=0; i<rayCount; ++i) {
+        if (m_hitFlags[i])
+            continue;
+        uint32_t path = m_shadowRays.path[i];
+        m_radianceR[path] += m_shadowR[i];
+        m_radianceG[path] += m_shadowG[i];
+        m_radianceB[path] += m_shadowB[i];
+    }
+}
+
+std::string WavefrontRenderer::toString() const {
+    return tfm::format("WavefrontRenderer[bsdfs=%i, batchSize=%i, interleave=%i]",
+                       m_bsdfIndex.size(), NORI_WAVEFRONT_BATCH, m_interleave);
+}
+
+NORI_NAMESPACE_END
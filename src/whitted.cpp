@@ -1,6 +1,7 @@
 #include <nori/bsdf.h>
 #include <nori/emitter.h>
 #include <nori/integrator.h>
+#include <nori/lightbvh.h>
 #include <nori/scene.h>
 #include <nori/warp.h>
 #include <pcg32.h>
@@ -9,59 +10,86 @@ NORI_NAMESPACE_BEGIN
 
 class WhittedIntegrator : public Integrator {
    private:
-    std::vector<Mesh *> m_emitters;
+    LightBVH m_lightBVH;
 
    public:
     WhittedIntegrator(const PropertyList &props) {}
 
-    void preprocess(const Scene *scene) { m_emitters = scene->getEmitters(); }
+    void preprocess(const Scene *scene) {
+        m_lightBVH.build(scene->getEmitters());
+    }
 
     Color3f Li(const Scene *scene, Sampler *sampler, const Ray3f &ray) const {
+        Color3f result = 0, throughput = 1;
+        Ray3f r(ray);
         Intersection its;
-        Color3f result = 0;
-        if (!scene->rayIntersect(ray, its)) {
-            return result;
+
+        // specular 표면에서는 반사/굴절된 ray를 계속 따라감
+        while (scene->rayIntersect(r, its)) {
+            ShadingRecord sRec;
+            shade(scene, sampler, r, its, sRec);
+            if (sRec.shadow && !scene->rayIntersect(sRec.shadowRay))
+                result += throughput * sRec.shadowValue;
+            if (!sRec.extend)
+                break;
+            throughput *= sRec.weight;
+            r = sRec.ray;
         }
+        return result;
+    }
 
+    void shade(const Scene *scene, Sampler *sampler, const Ray3f &ray,
+               const Intersection &its, ShadingRecord &sRec) const {
         if (its.mesh->getBSDF()->isDiffuse() && !its.mesh->isEmitter()) {
-            for (Mesh *emitter : m_emitters) {
-                Point3f y, x = its.p;  // light sampled point, mesh its point
-                Normal3f nY, nX = its.shFrame.n;  // y, x에서의 normal vector
-                Point2f random = sampler->next2D();
-                float pdfPos = emitter->samplePosition(random, y, nY);
-                Vector3f delta = y - x;
-                Vector3f wi = delta.normalized();
-                // self-intersection을 피하기 위한 offset
-                Ray3f shadowRay = Ray3f(x + nX * Epsilon, wi, Epsilon,
-                                        delta.norm() - Epsilon);
-                if (!scene->rayIntersect(shadowRay)) {
-                    BSDFQueryRecord bRec(its.shFrame.toLocal(wi),
-                                         its.shFrame.toLocal(-ray.d),
-                                         ESolidAngle);
-                    Color3f fr = its.mesh->getBSDF()->eval(bRec);
-                    Color3f G = abs(nX.dot(wi)) * abs(nY.dot(-wi)) /
-                                delta.squaredNorm();
-                    Color3f Le = emitter->getEmitter()->getRadiance();
-                    Color3f Lr = Le * fr * G;
-                    result += Lr / pdfPos;
-                }
-            }
-            result /= m_emitters.size();
+            Point3f y, x = its.p;  // light sampled point, mesh its point
+            Normal3f nY, nX = its.shFrame.n;  // y, x에서의 normal vector
+
+            // light BVH에서 기여도에 비례해 emitter triangle 하나를 선택
+            const Mesh *emitter;
+            uint32_t triangle;
+            float pmf;
+            if (!m_lightBVH.sample(x, nX, sampler->next1D(), emitter,
+                                   triangle, pmf))
+                return;
+            emitter->sampleTriangle(triangle, sampler->next2D(), y, nY);
+            float pdfPos = pmf / emitter->surfaceArea(triangle);
+
+            EmitterQueryRecord lRec(x, y, nY);
+            Vector3f wi = lRec.wi;
+            // self-intersection을 피하기 위한 offset
+            sRec.shadowRay = Ray3f(x + nX * Epsilon, wi, Epsilon,
+                                   lRec.dist - Epsilon);
+
+            BSDFQueryRecord bRec(its.shFrame.toLocal(wi),
+                                 its.shFrame.toLocal(-ray.d),
+                                 ESolidAngle);
+            Color3f fr = its.mesh->getBSDF()->eval(bRec);
+            Color3f G = abs(nX.dot(wi)) * abs(nY.dot(-wi)) /
+                        (lRec.dist * lRec.dist);
+            Color3f Le = emitter->getEmitter()->eval(lRec);
+            Color3f Lr = Le * fr * G;
+            sRec.shadowValue = Lr / pdfPos;
+            sRec.shadow = true;
         } else {
             if (sampler->next1D() < 0.95f) {
                 BSDFQueryRecord bRec(its.shFrame.toLocal(-ray.d));
                 Color3f weight =
                     its.mesh->getBSDF()->sample(bRec, sampler->next2D());
-                if (weight.x() == 0) return 0.f;
-                Ray3f newRay = Ray3f(its.p, its.shFrame.toWorld(bRec.wo));
-                result += (1 / 0.95) * weight * Li(scene, sampler, newRay);
+                if (weight.x() == 0) return;
+                sRec.ray = Ray3f(its.p, its.shFrame.toWorld(bRec.wo));
+                sRec.weight = (1 / 0.95) * weight;
+                sRec.extend = true;
             }
         }
-        return result;
     }
 
-    std::string toString() const { return "WhittedIntegrator[]"; }
+    bool supportsWavefront() const { return true; }
+
+    std::string toString() const {
+        return tfm::format("WhittedIntegrator[lightBVH=%s]",
+                           m_lightBVH.toString());
+    }
 };
 
 NORI_REGISTER_CLASS(WhittedIntegrator, "whitted");
-NORI_NAMESPACE_END
\ No newline at end of file
+NORI_NAMESPACE_END